@@ -0,0 +1,153 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// maps are generated on a square of this side
+#define MAP_SIDE 1000.0
+#define MAX_CITIES 64
+// every city of a sparse map gets roads to this many of its nearest cities
+#define SPARSE_NEIGHBOURS 3
+
+// splitmix64, so the same seed produces the same map on every libc
+typedef struct {
+  uint64_t state;
+} Rng_t;
+
+static uint64_t rng_next(Rng_t *rng) {
+  uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static double rng_uniform(Rng_t *rng) {
+  return (double)(rng_next(rng) >> 11) / (double)(1ull << 53);
+}
+
+typedef struct {
+  double x, y;
+} Point_t;
+
+static void euclid_points(Rng_t *rng, Point_t *points, int n) {
+  for (int i = 0; i < n; i++) {
+    points[i].x = rng_uniform(rng) * MAP_SIDE;
+    points[i].y = rng_uniform(rng) * MAP_SIDE;
+  }
+}
+
+// a few tight groups of cities far away from each other
+static void clustered_points(Rng_t *rng, Point_t *points, int n) {
+  int cluster_cnt = 2 + (int)(rng_next(rng) % 3);
+  Point_t centers[4];
+  euclid_points(rng, centers, cluster_cnt);
+
+  for (int i = 0; i < n; i++) {
+    Point_t *center = &centers[rng_next(rng) % cluster_cnt];
+    // the sum of uniforms is close enough to a normal distribution
+    double dx = 0, dy = 0;
+    for (int j = 0; j < 4; j++) {
+      dx += rng_uniform(rng) - 0.5;
+      dy += rng_uniform(rng) - 0.5;
+    }
+
+    points[i].x = center->x + dx * MAP_SIDE / 10;
+    points[i].y = center->y + dy * MAP_SIDE / 10;
+  }
+}
+
+static int distance(Point_t *a, Point_t *b) {
+  return (int)lround(hypot(a->x - b->x, a->y - b->y));
+}
+
+// mark the roads of a sparse map in roads. Sparse maps keep a random cycle
+// through all cities, so there always is a solution, plus roads to the
+// nearest neighbours of every city
+static void sparse_roads(Rng_t *rng, Point_t *points, int n,
+                         int roads[MAX_CITIES][MAX_CITIES]) {
+  int order[MAX_CITIES];
+  for (int i = 0; i < n; i++)
+    order[i] = i;
+
+  for (int i = n - 1; i > 0; i--) {
+    int j = (int)(rng_next(rng) % (uint64_t)(i + 1));
+    int tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int a = order[i], b = order[(i + 1) % n];
+    roads[a][b] = roads[b][a] = 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    int taken[MAX_CITIES] = {0};
+    taken[i] = 1;
+    for (int picked = 0; picked < SPARSE_NEIGHBOURS && picked < n - 1;
+         picked++) {
+      int nearest = -1;
+      for (int j = 0; j < n; j++)
+        if (!taken[j] && (nearest < 0 || distance(&points[i], &points[j]) <
+                                             distance(&points[i],
+                                                      &points[nearest])))
+          nearest = j;
+
+      taken[nearest] = 1;
+      roads[i][nearest] = roads[nearest][i] = 1;
+    }
+  }
+}
+
+static int print_usage(const char *prog) {
+  fprintf(stderr, "Usage: %s <euclid | clustered | sparse> <cities> <seed>\n",
+          prog);
+  return 1;
+}
+
+int main(int argc, const char **argv) {
+  if (argc != 4)
+    return print_usage(argv[0]);
+
+  const char *family = argv[1];
+  char *end;
+  long n = strtol(argv[2], &end, 10);
+  if (*end || n < 1 || n > MAX_CITIES) {
+    fprintf(stderr, "city count must be between 1 and %d\n", MAX_CITIES);
+    return 1;
+  }
+
+  uint64_t seed = strtoull(argv[3], &end, 10);
+  if (*end) {
+    fprintf(stderr, "seed must be a number\n");
+    return 1;
+  }
+
+  // mix the family and size into the seed, so every map of a run differs
+  Rng_t rng = {seed * 1000003 + (uint64_t)n};
+  for (const char *c = family; *c; c++)
+    rng.state = rng.state * 31 + (uint64_t)*c;
+
+  Point_t points[MAX_CITIES];
+  static int roads[MAX_CITIES][MAX_CITIES];
+  if (strcmp(family, "euclid") == 0) {
+    euclid_points(&rng, points, (int)n);
+  } else if (strcmp(family, "clustered") == 0) {
+    clustered_points(&rng, points, (int)n);
+  } else if (strcmp(family, "sparse") == 0) {
+    euclid_points(&rng, points, (int)n);
+    sparse_roads(&rng, points, (int)n, roads);
+  } else {
+    return print_usage(argv[0]);
+  }
+
+  int sparse = strcmp(family, "sparse") == 0;
+  for (int i = 0; i < n; i++)
+    for (int j = i + 1; j < n; j++)
+      if (!sparse || roads[i][j])
+        printf("City%d-City%d: %d\n", i, j, distance(&points[i], &points[j]));
+
+  return 0;
+}
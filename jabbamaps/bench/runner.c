@@ -0,0 +1,205 @@
+#define JABBAMAPS_NO_MAIN
+#include "../src/jabbamaps.c"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// hardware counters recorded around the DP
+static const struct {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+} counter_events[] = {
+#ifdef __linux__
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache_misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses"},
+#else
+    {0, 0, "cycles"},
+    {0, 0, "instructions"},
+    {0, 0, "cache_misses"},
+    {0, 0, "branch_misses"},
+#endif
+};
+#define COUNTER_CNT (sizeof(counter_events) / sizeof(counter_events[0]))
+
+// a file descriptor per counter, -1 for the ones that aren't available
+typedef struct {
+  int fds[COUNTER_CNT];
+  uint64_t values[COUNTER_CNT];
+} Counters_t;
+
+static void counters_open(Counters_t *counters) {
+  for (size_t i = 0; i < COUNTER_CNT; i++) {
+    counters->fds[i] = -1;
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[i].type;
+    attr.config = counter_events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // count this thread, on any cpu
+    counters->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+}
+
+static void counters_start(Counters_t *counters) {
+  for (size_t i = 0; i < COUNTER_CNT; i++) {
+    if (counters->fds[i] < 0)
+      continue;
+#ifdef __linux__
+    ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+}
+
+static void counters_stop(Counters_t *counters) {
+  for (size_t i = 0; i < COUNTER_CNT; i++) {
+    if (counters->fds[i] < 0)
+      continue;
+#ifdef __linux__
+    ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    if (read(counters->fds[i], &counters->values[i], sizeof(uint64_t)) !=
+        sizeof(uint64_t))
+      counters->values[i] = 0;
+  }
+}
+
+static void counters_close(Counters_t *counters) {
+  for (size_t i = 0; i < COUNTER_CNT; i++)
+    if (counters->fds[i] >= 0)
+      close(counters->fds[i]);
+}
+
+// the timings of a single map
+typedef struct {
+  int city_cnt;
+  double parse, subsets, dp, reconstruct;
+  int64_t cost;
+} BenchResult_t;
+
+// solve the map in filename one phase at a time, timing every phase
+static int bench_map(const char *filename, int sparse, Counters_t *counters,
+                     BenchResult_t *result) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Map_t map;
+  if (!map_load(filename, &map))
+    return 0;
+  result->parse = seconds_since(&start);
+  result->city_cnt = (int)map.cities.len;
+
+  Workspace_t ws;
+  workspace_init(&ws);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (!workspace_combs(&ws, result->city_cnt)) {
+    map_deinit(&map);
+    return 0;
+  }
+  result->subsets = seconds_since(&start);
+
+  // allocating is part of the DP, since that's also where the memo gets
+  // touched for the first time
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  counters_start(counters);
+  int ok = memo_reserve(&ws.memo, result->city_cnt);
+  if (ok && sparse) {
+    ws.reach_cap = (size_t)1 << result->city_cnt;
+    ws.reach = (uint64_t *)malloc(ws.reach_cap * sizeof(uint64_t));
+    ok = ws.reach &&
+         held_karp_sparse(&map.costs, &ws.memo, &ws.combs, ws.reach);
+  } else if (ok) {
+    ok = held_karp_tsp(&map.costs, &ws.memo, &ws.combs, NULL);
+  }
+  counters_stop(counters);
+  result->dp = seconds_since(&start);
+
+  DynamicArray_t(int) route;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (ok)
+    ok = sparse ? construct_sparse_tour(&ws.memo, ws.reach, &map.costs, &route)
+                : construct_tour(&ws.memo, &map.costs, &route, 0);
+  result->reconstruct = seconds_since(&start);
+
+  if (ok) {
+    result->cost = route_cost(&route, &map.costs, 0);
+    da_deinit(int)(&route, NULL);
+  }
+
+  workspace_deinit(&ws);
+  map_deinit(&map);
+  return ok;
+}
+
+static int print_runner_usage(const char *prog) {
+  fprintf(stderr, "Usage: %s <output.csv> <map>...\n", prog);
+  fprintf(stderr, "Maps whose name starts with 'sparse' are solved with the "
+                  "sparse solver\n");
+  return 1;
+}
+
+int main(int argc, const char **argv) {
+  if (argc < 3)
+    return print_runner_usage(argv[0]);
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out) {
+    perror("could not open output file");
+    return 1;
+  }
+
+  Counters_t counters;
+  counters_open(&counters);
+
+  fprintf(out, "map,cities,solver,parse_s,subsets_s,dp_s,reconstruct_s,cost");
+  for (size_t i = 0; i < COUNTER_CNT; i++)
+    fprintf(out, ",%s", counter_events[i].name);
+  fprintf(out, "\n");
+
+  int res = 0;
+  for (int i = 2; i < argc; i++) {
+    const char *base = strrchr(argv[i], '/');
+    base = base ? base + 1 : argv[i];
+    int sparse = strncmp(base, "sparse", strlen("sparse")) == 0;
+
+    BenchResult_t result = {0};
+    if (!bench_map(argv[i], sparse, &counters, &result)) {
+      fprintf(stderr, "could not benchmark %s\n", argv[i]);
+      res = 1;
+      continue;
+    }
+
+    fprintf(out, "%s,%d,%s,%.6f,%.6f,%.6f,%.6f,%" PRId64, base,
+            result.city_cnt, sparse ? "sparse" : "dense", result.parse,
+            result.subsets, result.dp, result.reconstruct, result.cost);
+    // unavailable counters are left empty
+    for (size_t j = 0; j < COUNTER_CNT; j++) {
+      if (counters.fds[j] >= 0)
+        fprintf(out, ",%" PRIu64, counters.values[j]);
+      else
+        fprintf(out, ",");
+    }
+    fprintf(out, "\n");
+    fflush(out);
+    fprintf(stderr, "%s: %.3fs\n", base,
+            result.parse + result.subsets + result.dp + result.reconstruct);
+  }
+
+  counters_close(&counters);
+  if (fclose(out) != 0) {
+    perror("could not write output file");
+    res = 1;
+  }
+
+  return res;
+}
@@ -1,22 +1,81 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "../../std.h/include/dynamic_array.h"
+#include "../../std.h/include/hash_map.h"
 
 #define SS_IMPL
 #include "../../std.h/include/string_slice.h"
 
+#include "jabbamaps.h"
+
+#ifdef JABBAMAPS_NO_MAIN
+// the library, the tests and the benchmark only need the solvers, so most of
+// the cli helpers end up unused
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+// the solvers say why they failed on stderr, except in the library, which
+// must not write to the stderr of the program that embeds it. There, failures
+// are only reported by jm_solve returning 0
+#ifdef JABBAMAPS_LIB
+#define solver_error(...) ((void)0)
+#define solver_perror(msg) ((void)0)
+#else
+#define solver_error(...) fprintf(stderr, __VA_ARGS__)
+#define solver_perror(msg) perror(msg)
+#endif
+
+// subsets are stored as 64-bit masks so we can't ever go above this
+#define MAX_CITIES 64
+// inputs are split into chunks of at least this many bytes, one per thread
+#define MIN_CHUNK_SZ (4 << 20)
+#define MAX_PARSE_THREADS 16
+// the maximum amount of threads a single solve is split into
+#define MAX_SOLVE_THREADS 16
+
 // a line in the input file
 typedef struct {
   uint8_t cities[2];
   int32_t cost;
 } CityEntry_t;
 
-typedef int32_t **DistanceMatrix_t;
+// the distances between all pairs of cities, in a single buffer.
+// Every row is padded to a multiple of DM_ALIGN bytes and the buffer itself is
+// DM_ALIGN aligned, so every row can be read with aligned vector loads.
+// The matrix is stored transposed(row k holds the distances *to* city k), which
+// makes the inner loop of the solver, that goes over all cities m for a fixed
+// k, read contiguous memory.
+// If all distances fit, entries are stored as int16_t instead of int32_t to
+// halve the amount of memory the solver has to go through.
+// Bit j of adj[i] is set if the input file contains a line connecting city i
+// and city j.
+typedef struct {
+  void *data;
+  // entries per row, including padding
+  size_t stride;
+  int city_cnt;
+  int narrow;
+  // data points into a compiled map file and must not be freed
+  int borrowed;
+  uint64_t adj[MAX_CITIES];
+} DistanceMatrix_t;
+
+#define DM_ALIGN 64
 
 // versions of dynamic array that are used
 DA_DECLARE_IMPL(Str_t)
@@ -25,183 +84,587 @@ DA_DECLARE_IMPL(DynamicArray_t(int64_t))
 DA_DECLARE_IMPL(int)
 DA_DECLARE_IMPL(CityEntry_t)
 
+// maps a city name to its index in the cities array
+HM_DECLARE_IMPL(Str_t, int)
+typedef HashMap_t(Str_t, int) CityIndex_t;
+
+// 64-bit FNV-1a hash. City names are short so we don't need anything fancier
+static uint64_t city_hash(Str_t *name) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < name->len; i++) {
+    hash ^= (uint8_t)name->s[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+static int city_eq(Str_t *a, Str_t *b) { return ss_eq(*a, *b); }
+
 static int print_usage(const char *prog) {
-  fprintf(stderr, "Usage: %s <filename>\n", prog);
+  fprintf(stderr, "Usage: %s [options] <filename>\n", prog);
+  fprintf(stderr, "       %s --all-starts <filename>\n", prog);
+  fprintf(stderr, "       %s --compile <filename> <output>\n", prog);
+  fprintf(stderr, "       %s --session <filename>\n", prog);
+  fprintf(stderr,
+          "       %s [options] --batch <directory | manifest> <output>\n",
+          prog);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --sparse        only travel along roads listed in the input\n");
+  fprintf(stderr, "  --mitm          solve by meeting in the middle, which "
+                  "needs a lot less memory\n");
+  fprintf(stderr, "  --progress      show how far along the solve is\n");
+  fprintf(stderr, "  --stats <file>  write timings and memory usage of the "
+                  "solve to file as JSON\n");
+  fprintf(stderr, "  --cache <file>  reuse solutions of maps solved before, "
+                  "keeping them in file\n");
+  fprintf(stderr, "  --time-budget <seconds>\n"
+                  "                  stop after this long and print the best "
+                  "route found so far\n");
+  fprintf(stderr, "  --memory-budget <MB>\n"
+                  "                  don't let the exact solvers use more "
+                  "memory than this\n");
   return 1;
 }
 
-static void **create_heap_table(size_t rows, size_t cols, size_t el_sz) {
-  void **dists = calloc(rows, sizeof(void *));
-  if (!dists)
-    return NULL;
+// create a zeroed matrix for city_cnt cities
+static int dm_init(DistanceMatrix_t *dm, int city_cnt, int narrow) {
+  size_t el_sz = narrow ? sizeof(int16_t) : sizeof(int32_t);
+  size_t per_line = DM_ALIGN / el_sz;
+  size_t stride = ((size_t)city_cnt + per_line - 1) / per_line * per_line;
+  // always allocate at least one row, so empty maps still get a buffer
+  size_t rows = city_cnt > 0 ? (size_t)city_cnt : 1;
+  size_t sz = (stride > 0 ? stride : per_line) * rows * el_sz;
+
+  void *data;
+  if (posix_memalign(&data, DM_ALIGN, sz) != 0)
+    return 0;
 
-  // since the zero-th city is never used we need to reduce the amount of
-  // entries by 1 in ever set
-  for (size_t i = 0; i < rows; i++) {
-    dists[i] = calloc(cols, el_sz);
-    if (!dists[i]) {
-      for (size_t j = 0; j < i; j++)
-        free(dists[j]);
+  memset(data, 0, sz);
+  memset(dm->adj, 0, sizeof(dm->adj));
+  dm->data = data;
+  dm->stride = stride;
+  dm->city_cnt = city_cnt;
+  dm->narrow = narrow;
+  dm->borrowed = 0;
 
-      free(dists);
-      return NULL;
-    }
-  }
+  return 1;
+}
 
-  return dists;
+static void dm_deinit(DistanceMatrix_t *dm) {
+  if (!dm->borrowed)
+    free(dm->data);
+  memset(dm, 0, sizeof(DistanceMatrix_t));
 }
 
-static void free_heap_table(size_t rows, void **buf) {
-  for (size_t i = 0; i < rows; i++)
-    free(buf[i]);
+// the distance from city from to city to
+static inline int32_t dm_get(const DistanceMatrix_t *dm, int from, int to) {
+  size_t idx = (size_t)to * dm->stride + (size_t)from;
+  return dm->narrow ? ((const int16_t *)dm->data)[idx]
+                    : ((const int32_t *)dm->data)[idx];
+}
 
-  free(buf);
+static inline void dm_set(DistanceMatrix_t *dm, int from, int to,
+                          int32_t dist) {
+  size_t idx = (size_t)to * dm->stride + (size_t)from;
+  if (dm->narrow)
+    ((int16_t *)dm->data)[idx] = (int16_t)dist;
+  else
+    ((int32_t *)dm->data)[idx] = dist;
 }
 
-// read the contents of input into a dynamically allocated buffer and return the
-// result in out_buf
-static int read_input(FILE *input, Str_t *out_s) {
-  // go to the end
-  // returns non-zero on failure
-  if (fseek(input, 0, SEEK_END) != 0) {
+// map the contents of the file called filename into memory and return them as a
+// string slice in out_s. The slice must be released with unmap_input
+static int mmap_file(const char *filename, Str_t *out_s) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror("could not open input file");
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
     perror("could not find the size of input file");
+    close(fd);
     return 0;
   }
-  // get the current position
-  long eof = ftell(input);
-  // return to the beginning
-  rewind(input);
 
-  size_t file_sz = eof;
+  out_s->s = NULL;
+  out_s->len = (size_t)st.st_size;
 
-  char *data = (char *)malloc(file_sz * sizeof(char));
-  if (!data) {
-    perror("could not allocate memory");
-    return 0;
+  // mmap refuses to create empty mappings, but an empty file is just an empty
+  // slice
+  if (out_s->len > 0) {
+    void *data = mmap(NULL, out_s->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      perror("could not map input file");
+      close(fd);
+      return 0;
+    }
+
+    out_s->s = (const char *)data;
   }
 
-  size_t bytes_read = (size_t)fread(data, sizeof(char), file_sz, input);
-  if (bytes_read != file_sz) {
-    fprintf(stderr, "read %zu bytes instead of %zu\n", file_sz, bytes_read);
+  // the mapping stays valid after the descriptor is closed
+  if (close(fd) != 0) {
+    perror("could not close input file");
+    if (out_s->s)
+      munmap((void *)out_s->s, out_s->len);
     return 0;
   }
 
-  out_s->s = data;
-  out_s->len = file_sz;
-
   return 1;
 }
 
-static int find_city(Str_t niddle, DynamicArray_t(Str_t) * haystack) {
-  for (size_t i = 0; i < haystack->len; i++)
-    if (ss_eq(haystack->buf[i], niddle))
-      return (int)i;
+static void munmap_file(Str_t data) {
+  if (data.s)
+    munmap((void *)data.s, data.len);
+}
 
-  return -1;
+// return the index of city, adding it to cities if we haven't seen it before.
+// The index is what the solver uses, so cities are numbered in the order they
+// first appear in.
+// Returns -1 on failure
+static int intern_city(Str_t city, DynamicArray_t(Str_t) * cities,
+                       CityIndex_t *index) {
+  int *idx = hm_get(Str_t, int)(index, &city);
+  if (idx)
+    return *idx;
+
+  if (cities->len >= MAX_CITIES) {
+    fprintf(stderr, "input file contains more than %d cities\n", MAX_CITIES);
+    return -1;
+  }
+
+  if (!da_push(Str_t)(cities, city))
+    return -1;
+
+  int new_idx = (int)cities->len - 1;
+  if (!hm_put(Str_t, int)(index, city, new_idx))
+    return -1;
+
+  return new_idx;
 }
 
 static int read_city_until(Str_t *line, char delim,
-                           DynamicArray_t(Str_t) * cities) {
+                           DynamicArray_t(Str_t) * cities, CityIndex_t *index) {
   Str_t city = ss_trim(ss_split_once(line, delim));
-  int idx = find_city(city, cities);
-  if (idx < 0) {
-    // cant fail since it's stack allocated
-    da_push(Str_t)(cities, city);
-    idx = cities->len - 1;
-  }
-
-  return idx;
+  return intern_city(city, cities, index);
 }
 
-static int parse_input(Str_t buf, DynamicArray_t(Str_t) * cities,
-                       DistanceMatrix_t *costs_out) {
-  char local_buf[12];
-  char *end;
-  Str_t line;
+// parse a decimal integer spanning the whole of s into out
+// this replaces strtol so we don't need to copy every number into a null
+// terminated buffer first
+static int parse_cost(Str_t s, int32_t *out) {
+  int negative = 0;
+  if (s.len > 0 && (*s.s == '-' || *s.s == '+'))
+    negative = ss_advance_once(&s) == '-';
 
-  DynamicArray_t(CityEntry_t) distances;
-  if (!da_init(CityEntry_t)(&distances, 16))
+  if (s.len == 0) {
+    fprintf(stderr, "missing distance after ':'\n");
     return 0;
+  }
 
-  buf = ss_trim(buf);
-  while (buf.len != 0) {
-    line = ss_trim(ss_split_once(&buf, '\n'));
-    int loc_1 = read_city_until(&line, '-', cities);
-    int loc_2 = read_city_until(&line, ':', cities);
+  int64_t value = 0;
+  for (size_t i = 0; i < s.len; i++) {
+    unsigned digit = (unsigned)(s.s[i] - '0');
+    if (digit > 9) {
+      fprintf(stderr, "could not read integer from '%.*s'\n", (int)s.len, s.s);
+      return 0;
+    }
 
-    memset(local_buf, 0, sizeof(local_buf));
-    if (line.len > sizeof(local_buf)) {
+    value = value * 10 + digit;
+    // -2^31 is the only value that fits when negative but not when positive
+    if (value > (int64_t)INT32_MAX + negative) {
       fprintf(stderr, "number exceeded 2^31\n");
       return 0;
     }
+  }
+
+  *out = (int32_t)(negative ? -value : value);
+  return 1;
+}
 
-    memcpy(local_buf, line.s, line.len);
+// a contiguous group of lines of the input file, parsed by a single thread.
+// The cities in entries are indices into the cities array of the job, since
+// jobs don't share their city indices while they run
+typedef struct {
+  Str_t chunk;
+  DynamicArray_t(Str_t) cities;
+  DynamicArray_t(CityEntry_t) entries;
+  int ok;
+} ParseJob_t;
+
+static int parse_lines(Str_t buf, DynamicArray_t(Str_t) * cities,
+                       CityIndex_t *index,
+                       DynamicArray_t(CityEntry_t) * entries) {
+  while (buf.len != 0) {
+    Str_t line = ss_trim(ss_split_once(&buf, '\n'));
+    // tolerate blank lines
+    if (line.len == 0)
+      continue;
 
-    CityEntry_t entry = {.cities = {loc_1, loc_2},
-                         .cost = (int32_t)strtol(local_buf, &end, 10)};
+    int loc_1 = read_city_until(&line, '-', cities, index);
+    int loc_2 = read_city_until(&line, ':', cities, index);
+    if (loc_1 < 0 || loc_2 < 0)
+      return 0;
 
-    // WARN: errno code does not compile with -m32
-    // assuming we cannot fail with ERANGE
-    if (end == local_buf /*|| errno != 0*/) {
-      fprintf(stderr, "could not read integer from buffer %12s\n", local_buf);
-      da_deinit(CityEntry_t)(&distances, NULL);
+    CityEntry_t entry = {.cities = {loc_1, loc_2}};
+    if (!parse_cost(ss_trim(line), &entry.cost))
       return 0;
-    }
 
-    if (!da_push(CityEntry_t)(&distances, entry)) {
-      da_deinit(CityEntry_t)(&distances, NULL);
+    if (!da_push(CityEntry_t)(entries, entry))
       return 0;
-    }
   }
 
-  // create distance matrix
-  DistanceMatrix_t costs = (DistanceMatrix_t)create_heap_table(
-      cities->len, cities->len, sizeof(int32_t));
+  return 1;
+}
 
-  if (!costs) {
-    da_deinit(CityEntry_t)(&distances, NULL);
-    return 0;
+// thread entry point, arg is a ParseJob_t
+static void *parse_chunk(void *arg) {
+  ParseJob_t *job = (ParseJob_t *)arg;
+  job->ok = 0;
+
+  CityIndex_t index;
+  if (!hm_init(Str_t, int)(&index, 2 * MAX_CITIES, city_hash, city_eq))
+    return NULL;
+
+  job->ok = parse_lines(job->chunk, &job->cities, &index, &job->entries);
+
+  hm_deinit(Str_t, int)(&index, NULL);
+  return NULL;
+}
+
+static void parse_job_deinit(ParseJob_t *job) {
+  da_deinit(Str_t)(&job->cities, NULL);
+  da_deinit(CityEntry_t)(&job->entries, NULL);
+}
+
+// how many threads to split buf into. Small files aren't worth the trouble of
+// spawning threads for
+static size_t parse_thread_count(Str_t buf) {
+  size_t threads = buf.len / MIN_CHUNK_SZ;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus > 0 && threads > (size_t)cpus)
+    threads = (size_t)cpus;
+
+  if (threads > MAX_PARSE_THREADS)
+    threads = MAX_PARSE_THREADS;
+
+  return threads > 0 ? threads : 1;
+}
+
+// split buf into job_cnt chunks that all end on line boundaries
+static void split_chunks(Str_t buf, ParseJob_t *jobs, size_t job_cnt) {
+  const char *end = buf.s + buf.len;
+  const char *start = buf.s;
+  for (size_t i = 0; i < job_cnt; i++) {
+    const char *chunk_end =
+        i == job_cnt - 1 ? end : buf.s + buf.len / job_cnt * (i + 1);
+    // the previous chunk might have eaten into our share
+    if (chunk_end < start)
+      chunk_end = start;
+
+    // move forward until we are just past a newline
+    while (chunk_end < end && chunk_end > buf.s && chunk_end[-1] != '\n')
+      chunk_end++;
+
+    jobs[i].chunk = (Str_t){.s = start, .len = (size_t)(chunk_end - start)};
+    start = chunk_end;
+  }
+}
+
+// parse all jobs, each one on its own thread. The first job runs on the calling
+// thread
+static int run_parse_jobs(ParseJob_t *jobs, size_t job_cnt) {
+  pthread_t threads[MAX_PARSE_THREADS];
+  int spawned[MAX_PARSE_THREADS] = {0};
+
+  for (size_t i = 1; i < job_cnt; i++)
+    spawned[i] = pthread_create(&threads[i], NULL, parse_chunk, &jobs[i]) == 0;
+
+  parse_chunk(&jobs[0]);
+
+  int ok = jobs[0].ok;
+  for (size_t i = 1; i < job_cnt; i++) {
+    // if we couldn't get a thread, we just do the work ourselves
+    if (spawned[i])
+      pthread_join(threads[i], NULL);
+    else
+      parse_chunk(&jobs[i]);
+
+    ok = ok && jobs[i].ok;
   }
 
-  for (CityEntry_t *curr = distances.buf; curr < distances.buf + distances.len;
-       curr++) {
-    // we are doing this symmetrically
-    // technically speaking we could save on some memory but it's infinite
-    // anyways so who cares(:upside_down:)
-    costs[curr->cities[0]][curr->cities[1]] = curr->cost;
-    costs[curr->cities[1]][curr->cities[0]] = curr->cost;
+  return ok;
+}
+
+// translate the job-local city indices of job into indices in cities.
+// Jobs are merged in file order, so the numbering is the same one a single
+// thread would have produced
+static int merge_job(ParseJob_t *job, DynamicArray_t(Str_t) * cities,
+                     CityIndex_t *index) {
+  uint8_t remap[MAX_CITIES];
+  for (size_t i = 0; i < job->cities.len; i++) {
+    int idx = intern_city(job->cities.buf[i], cities, index);
+    if (idx < 0)
+      return 0;
+
+    remap[i] = (uint8_t)idx;
   }
 
-  *costs_out = costs;
+  for (CityEntry_t *curr = job->entries.buf;
+       curr < job->entries.buf + job->entries.len; curr++) {
+    curr->cities[0] = remap[curr->cities[0]];
+    curr->cities[1] = remap[curr->cities[1]];
+  }
 
-  da_deinit(CityEntry_t)(&distances, NULL);
   return 1;
 }
 
+// parse buf split into job_cnt chunks, at most MAX_PARSE_THREADS of them.
+// The result is the same no matter how many jobs there are
+static int parse_input_jobs(Str_t buf, size_t job_cnt,
+                            DynamicArray_t(Str_t) * cities,
+                            DistanceMatrix_t *costs_out) {
+  ParseJob_t jobs[MAX_PARSE_THREADS];
+
+  for (size_t i = 0; i < job_cnt; i++) {
+    if (!da_init(Str_t)(&jobs[i].cities, 16) ||
+        !da_init(CityEntry_t)(&jobs[i].entries, 16)) {
+      // deinit on a NULL buffer is a no-op
+      da_deinit(Str_t)(&jobs[i].cities, NULL);
+      for (size_t j = 0; j < i; j++)
+        parse_job_deinit(&jobs[j]);
+      return 0;
+    }
+  }
+
+  split_chunks(buf, jobs, job_cnt);
+
+  int ok = run_parse_jobs(jobs, job_cnt);
+
+  CityIndex_t index;
+  if (ok)
+    ok = hm_init(Str_t, int)(&index, 2 * MAX_CITIES, city_hash, city_eq);
+
+  if (ok) {
+    for (size_t i = 0; i < job_cnt && ok; i++)
+      ok = merge_job(&jobs[i], cities, &index);
+
+    hm_deinit(Str_t, int)(&index, NULL);
+  }
+
+  // use the narrow matrix if every distance fits in it
+  int narrow = 1;
+  for (size_t i = 0; i < job_cnt && ok && narrow; i++) {
+    DynamicArray_t(CityEntry_t) *entries = &jobs[i].entries;
+    for (CityEntry_t *curr = entries->buf; curr < entries->buf + entries->len;
+         curr++) {
+      if (curr->cost < INT16_MIN || curr->cost > INT16_MAX) {
+        narrow = 0;
+        break;
+      }
+    }
+  }
+
+  // create distance matrix
+  if (ok)
+    ok = dm_init(costs_out, (int)cities->len, narrow);
+
+  for (size_t i = 0; i < job_cnt; i++) {
+    if (ok) {
+      DynamicArray_t(CityEntry_t) *entries = &jobs[i].entries;
+      for (CityEntry_t *curr = entries->buf; curr < entries->buf + entries->len;
+           curr++) {
+        // we are doing this symmetrically
+        // technically speaking we could save on some memory but it's infinite
+        // anyways so who cares(:upside_down:)
+        dm_set(costs_out, curr->cities[0], curr->cities[1], curr->cost);
+        dm_set(costs_out, curr->cities[1], curr->cities[0], curr->cost);
+
+        // a city is never its own neighbour
+        if (curr->cities[0] != curr->cities[1]) {
+          costs_out->adj[curr->cities[0]] |= (uint64_t)1 << curr->cities[1];
+          costs_out->adj[curr->cities[1]] |= (uint64_t)1 << curr->cities[0];
+        }
+      }
+    }
+
+    parse_job_deinit(&jobs[i]);
+  }
+
+  return ok;
+}
+
+static int parse_input(Str_t buf, DynamicArray_t(Str_t) * cities,
+                       DistanceMatrix_t *costs_out) {
+  return parse_input_jobs(buf, parse_thread_count(buf), cities, costs_out);
+}
+
+// the amount of threads a single solve should be split into
+static size_t solve_thread_count(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1)
+    return 1;
+
+  return cpus > MAX_SOLVE_THREADS ? MAX_SOLVE_THREADS : (size_t)cpus;
+}
+
+// a single buffer holding city_cnt rows of 2^city_cnt entries.
+// The buffer is only ever grown, so the same memo can be reused for many maps
 typedef struct {
-  int64_t **dists;
+  int64_t *dists;
+  size_t cap;
+  // the size of the mapping dists points to
+  size_t mapped;
   int city_cnt;
+  // the most threads that fault in the pages of a new mapping, 0 for as many
+  // as a solve gets
+  size_t touch_threads;
 } Memo_t;
 
-static int create_memo(DynamicArray_t(Str_t) * cities, Memo_t *memo) {
-  size_t subsets = 1 << cities->len;
-  memo->dists =
-      (int64_t **)create_heap_table(cities->len, subsets, sizeof(int64_t));
-  if (!memo->dists)
+// the cached distance of subset S, given that k is the last city visited
+#define memo_at(memo, k, S)                                                    \
+  ((memo)->dists[((size_t)(k) << (memo)->city_cnt) | (size_t)(S)])
+
+static void memo_init(Memo_t *memo) { memset(memo, 0, sizeof(Memo_t)); }
+
+// the size of a huge page on x86-64. Memos at least this big try to use them
+#define HUGE_PAGE_SZ ((size_t)2 << 20)
+
+typedef struct {
+  volatile char *start;
+  size_t len;
+  size_t page_sz;
+} TouchJob_t;
+
+// thread entry point, arg is a TouchJob_t
+static void *touch_pages(void *arg) {
+  TouchJob_t *job = (TouchJob_t *)arg;
+  for (size_t off = 0; off < job->len; off += job->page_sz)
+    job->start[off] = 0;
+
+  return NULL;
+}
+
+// fault in every page of data, split between threads. With NUMA, every page
+// ends up on the node of the thread that touched it first, so the memo is
+// spread over all of them instead of piling up on a single one
+static void first_touch(char *data, size_t len, size_t page_sz,
+                        size_t threads) {
+  size_t pages = len / page_sz;
+  if (threads > pages)
+    threads = pages > 0 ? pages : 1;
+
+  TouchJob_t jobs[MAX_SOLVE_THREADS];
+  for (size_t i = 0; i < threads; i++) {
+    size_t first = pages / threads * i;
+    size_t last = i == threads - 1 ? pages : pages / threads * (i + 1);
+    jobs[i] = (TouchJob_t){.start = data + first * page_sz,
+                           .len = (last - first) * page_sz,
+                           .page_sz = page_sz};
+  }
+
+  pthread_t handles[MAX_SOLVE_THREADS];
+  int spawned[MAX_SOLVE_THREADS] = {0};
+  for (size_t i = 1; i < threads; i++)
+    spawned[i] = pthread_create(&handles[i], NULL, touch_pages, &jobs[i]) == 0;
+
+  touch_pages(&jobs[0]);
+  for (size_t i = 1; i < threads; i++) {
+    if (spawned[i])
+      pthread_join(handles[i], NULL);
+    else
+      touch_pages(&jobs[i]);
+  }
+}
+
+// map sz bytes of zeroed memory for a memo and store the size of the mapping
+// into mapped. Reserved huge pages are used if there are enough of them.
+// Otherwise we ask for transparent huge pages, and if the system won't give us
+// those either, we get normal pages.
+// Every page is faulted in by threads threads before returning, so the solver
+// never stops for a page fault
+static int64_t *memo_map(size_t sz, size_t threads, size_t *mapped) {
+  void *data = MAP_FAILED;
+  size_t len = sz;
+
+#ifdef MAP_HUGETLB
+  if (sz >= HUGE_PAGE_SZ) {
+    len = (sz + HUGE_PAGE_SZ - 1) / HUGE_PAGE_SZ * HUGE_PAGE_SZ;
+    // with a single thread there is nothing to split, so let the kernel do it
+    int populate = threads == 1 ? MAP_POPULATE : 0;
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+    if (data != MAP_FAILED && !populate)
+      first_touch((char *)data, len, HUGE_PAGE_SZ, threads);
+  }
+#endif
+
+  if (data == MAP_FAILED) {
+    len = sz;
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0);
+    if (data == MAP_FAILED)
+      return NULL;
+
+#ifdef MADV_HUGEPAGE
+    // this has to happen before the pages are faulted in, and it's fine if
+    // the system doesn't support it
+    if (sz >= HUGE_PAGE_SZ)
+      madvise(data, len, MADV_HUGEPAGE);
+#endif
+
+    first_touch((char *)data, len, (size_t)sysconf(_SC_PAGESIZE), threads);
+  }
+
+  *mapped = len;
+  return (int64_t *)data;
+}
+
+// make memo big enough to solve a map of city_cnt cities
+// The contents of the memo are not preserved
+static int memo_reserve(Memo_t *memo, int city_cnt) {
+  // city_cnt * 2^city_cnt entries need to be addressable
+  if ((size_t)city_cnt >= sizeof(size_t) * 8 - 1 ||
+      ((SIZE_MAX / sizeof(int64_t)) >> city_cnt) < (size_t)city_cnt) {
+    solver_error("%d cities do not fit in memory\n", city_cnt);
     return 0;
+  }
 
-  memo->city_cnt = cities->len;
+  size_t entries = (size_t)city_cnt << city_cnt;
+  if (entries > memo->cap) {
+    // we don't care about the old contents so there's no point in mremap
+    if (memo->dists)
+      munmap(memo->dists, memo->mapped);
+
+    size_t threads = solve_thread_count();
+    if (memo->touch_threads > 0 && memo->touch_threads < threads)
+      threads = memo->touch_threads;
+    memo->dists = memo_map(entries * sizeof(int64_t), threads, &memo->mapped);
+    if (!memo->dists) {
+      solver_perror("could not allocate memo");
+      memo->cap = 0;
+      memo->mapped = 0;
+      return 0;
+    }
+
+    memo->cap = entries;
+  }
 
+  memo->city_cnt = city_cnt;
   return 1;
 }
 
 static void free_memo(Memo_t *memo) {
-  free_heap_table(memo->city_cnt, (void **)memo->dists);
+  if (memo->dists)
+    munmap(memo->dists, memo->mapped);
   memset(memo, 0, sizeof(Memo_t));
 }
 
 // check if the bit-th bit is set on the bitset bs
-#define is_set(bs, bit) (bs & (1 << bit))
+#define is_set(bs, bit) ((bs) & ((int64_t)1 << (bit)))
 static void int64_arr_destroy(DynamicArray_t(int64_t) arr) {
   da_deinit(int64_t)(&arr, NULL);
 }
@@ -233,8 +696,8 @@ static int generate_combination_matrix(CombinationBuffer_t *combs, int n) {
     nchoosek = (nchoosek * (n - k)) / (k + 1);
   }
 
-  for (int64_t i = 0; i < (1 << n); i++) {
-    int ones = __builtin_popcount(i);
+  for (int64_t i = 0; i < ((int64_t)1 << n); i++) {
+    int ones = __builtin_popcountll(i);
 
     DynamicArray_t(int64_t) *bucket = &combs->buf[ones];
 
@@ -247,73 +710,633 @@ static int generate_combination_matrix(CombinationBuffer_t *combs, int n) {
   return 1;
 }
 
+// binom[n][k] is n choose k
+static uint64_t binom[MAX_CITIES + 1][MAX_CITIES + 1];
+static pthread_once_t binom_once = PTHREAD_ONCE_INIT;
+
+static void init_binom(void) {
+  for (int n = 0; n <= MAX_CITIES; n++) {
+    binom[n][0] = 1;
+    for (int k = 1; k <= n; k++)
+      binom[n][k] = binom[n - 1][k - 1] + (k < n ? binom[n - 1][k] : 0);
+  }
+}
+
+// what held_karp_tsp did in a single layer, i.e. for all subsets of one size
+typedef struct {
+  double seconds;
+  // memo entries written
+  uint64_t states;
+  // estimated seconds until the whole solve is done
+  double eta;
+} LayerStats_t;
+
+// instrumentation for held_karp_tsp, recorded once per layer
+typedef struct {
+  // if not NULL, a progress line is kept up to date here
+  FILE *progress;
+  int city_cnt;
+  // layers[s] is the layer of subsets with s cities, only layers from 2 up to
+  // city_cnt are recorded
+  LayerStats_t layers[MAX_CITIES + 1];
+  int last_layer;
+  double seconds;
+  // bytes held by the memo, subset lists and distance matrix
+  size_t alloc_bytes;
+  // in bytes, as reported by getrusage
+  uint64_t peak_rss;
+  struct timespec start, layer_start;
+  // the work of all layers so far and in total, see layer_work
+  double work_done, work_total;
+} SolveStats_t;
+
+static double seconds_since(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - since->tv_sec) +
+         (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static uint64_t peak_rss(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  // linux reports kilobytes
+  return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+// a layer of subsets of size s has binom(n - 1, s - 1) subsets that contain
+// the start city, each of which costs about the same to solve
+static double layer_work(int city_cnt, int s) {
+  return (double)binom[city_cnt - 1][s - 1];
+}
+
+static void stats_begin(SolveStats_t *stats, int city_cnt, size_t alloc_bytes) {
+  pthread_once(&binom_once, init_binom);
+  FILE *progress = stats->progress;
+  memset(stats, 0, sizeof(SolveStats_t));
+  stats->progress = progress;
+  stats->city_cnt = city_cnt;
+  stats->alloc_bytes = alloc_bytes;
+  for (int s = 2; s <= city_cnt; s++)
+    stats->work_total += layer_work(city_cnt, s);
+
+  clock_gettime(CLOCK_MONOTONIC, &stats->start);
+  stats->layer_start = stats->start;
+}
+
+// record that layer s just finished
+static void stats_layer(SolveStats_t *stats, int s) {
+  LayerStats_t *layer = &stats->layers[s];
+  layer->seconds = seconds_since(&stats->layer_start);
+  layer->states = binom[stats->city_cnt - 1][s - 1] * (uint64_t)stats->city_cnt;
+  stats->work_done += layer_work(stats->city_cnt, s);
+  double elapsed = seconds_since(&stats->start);
+  layer->eta = elapsed / stats->work_done *
+               (stats->work_total - stats->work_done);
+  stats->last_layer = s;
+  clock_gettime(CLOCK_MONOTONIC, &stats->layer_start);
+
+  if (stats->progress) {
+    fprintf(stats->progress,
+            "\rlayer %2d/%d  %12" PRIu64 " states  %10.0f states/s  "
+            "%8.1fs elapsed  %8.1fs left  %6" PRIu64 " MiB peak",
+            s, stats->city_cnt, layer->states,
+            layer->seconds > 0 ? (double)layer->states / layer->seconds : 0,
+            elapsed, layer->eta, peak_rss() >> 20);
+    fflush(stats->progress);
+  }
+}
+
+static void stats_end(SolveStats_t *stats) {
+  stats->seconds = seconds_since(&stats->start);
+  stats->peak_rss = peak_rss();
+  if (stats->progress && stats->last_layer > 0)
+    fprintf(stats->progress, "\n");
+}
+
+// write stats out as a JSON object
+static void stats_write_json(SolveStats_t *stats, FILE *out) {
+  uint64_t total_states = 0;
+  for (int s = 2; s <= stats->last_layer; s++)
+    total_states += stats->layers[s].states;
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"cities\": %d,\n", stats->city_cnt);
+  fprintf(out, "  \"seconds\": %f,\n", stats->seconds);
+  fprintf(out, "  \"states\": %" PRIu64 ",\n", total_states);
+  fprintf(out, "  \"states_per_sec\": %f,\n",
+          stats->seconds > 0 ? (double)total_states / stats->seconds : 0);
+  fprintf(out, "  \"peak_rss_bytes\": %" PRIu64 ",\n", stats->peak_rss);
+  fprintf(out, "  \"alloc_bytes\": %zu,\n", stats->alloc_bytes);
+  fprintf(out, "  \"layers\": [");
+  for (int s = 2; s <= stats->last_layer; s++) {
+    LayerStats_t *layer = &stats->layers[s];
+    fprintf(out,
+            "%s\n    {\"size\": %d, \"seconds\": %f, \"states\": %" PRIu64
+            ", \"states_per_sec\": %f, \"eta_seconds\": %f}",
+            s == 2 ? "" : ",", s, layer->seconds, layer->states,
+            layer->seconds > 0 ? (double)layer->states / layer->seconds : 0,
+            layer->eta);
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+// lets whoever started a solve watch it and stop it. Solvers check it after
+// every layer, and once per chunk of CANCEL_CHECK_INTERVAL subsets within a
+// layer, so the loop over the subsets of a chunk is the same with or without
+// a control
+typedef struct {
+  // if not NULL, every layer is recorded here, see SolveStats_t
+  SolveStats_t *stats;
+  // if not NULL, the solve stops as soon as this becomes non zero
+  const int *cancel;
+  // if set, bound is kept up to date after every layer
+  int track_bound;
+  // the shortest road into every city
+  int64_t cheapest[MAX_CITIES];
+  // no path over all cities costs less than this. A path that first visits the
+  // cities of S, ending at k, costs at least g(S, k) plus the cheapest road
+  // into each of the cities that are left
+  int64_t bound;
+} SolveControl_t;
+
+#define CANCEL_CHECK_INTERVAL 4096
+
+static int solve_cancelled(const SolveControl_t *ctl) {
+  return ctl->cancel && __atomic_load_n(ctl->cancel, __ATOMIC_RELAXED);
+}
+
+// called by held_karp_tsp once the layer of subsets with s cities is done.
+// Returns 0 if the solve should stop
+static int solve_layer_done(SolveControl_t *ctl, Memo_t *memo,
+                            CombinationBuffer_t *combs, int s) {
+  if (ctl->stats)
+    stats_layer(ctl->stats, s);
+
+  if (ctl->track_bound) {
+    DynamicArray_t(int64_t) *subsets = &combs->buf[s];
+    int64_t bound = INT64_MAX;
+    for (size_t i = 0; i < subsets->len; i++) {
+      // the scan over a big layer takes about as long as solving it, so it
+      // has to stop on time too. A partial scan doesn't prove anything
+      if (i % CANCEL_CHECK_INTERVAL == 0 && solve_cancelled(ctl))
+        return 0;
+
+      int64_t S = subsets->buf[i];
+      if ((S & 1) == 0)
+        continue;
+
+      int64_t rest = 0;
+      for (int c = 1; c < memo->city_cnt; c++)
+        if (!is_set(S, c))
+          rest += ctl->cheapest[c];
+
+      for (int k = 1; k < memo->city_cnt; k++)
+        if (is_set(S, k) && memo_at(memo, k, S) + rest < bound)
+          bound = memo_at(memo, k, S) + rest;
+    }
+
+    if (bound != INT64_MAX && bound > ctl->bound)
+      ctl->bound = bound;
+  }
+
+  return !solve_cancelled(ctl);
+}
+
+// the body of held_karp_tsp, for a distance matrix with entries of type type.
+// cities is the amount of cities and state_t the type used for subsets. The
+// generic kernel passes in memo->city_cnt, while the sized kernels below pass
+// in a constant, so the compiler knows every loop bound and memo stride and
+// can unroll the inner loop completely
+#define HELD_KARP_KERNEL(name, type, cities, state_t)                          \
+  static int name(DistanceMatrix_t *cost, Memo_t *memo,                        \
+                  CombinationBuffer_t *combs, SolveControl_t *ctl) {           \
+    const type *dists = (const type *)cost->data;                              \
+    int64_t *memo_buf = memo->dists;                                           \
+    /* initialize 2 element subsets */                                         \
+    for (int i = 1; i < (cities); i++)                                         \
+      memo_buf[((size_t)i << (cities)) | (1 | ((state_t)1 << i))] =            \
+          dists[(size_t)i * cost->stride];                                     \
+    if (ctl && (cities) >= 2 && !solve_layer_done(ctl, memo, combs, 2))        \
+      return 0;                                                                \
+                                                                               \
+    /* for all subsets with 3 or more elements */                              \
+    for (int s = 3; s <= (cities); s++) {                                      \
+      DynamicArray_t(int64_t) *k_el_subsets = &combs->buf[s];                  \
+      /* look for cancellation once per chunk, so the loop over the subsets */ \
+      /* of a chunk is the same as without it */                               \
+      for (size_t chunk = 0; chunk < k_el_subsets->len;                        \
+           chunk += CANCEL_CHECK_INTERVAL) {                                   \
+        if (ctl && solve_cancelled(ctl))                                       \
+          return 0;                                                            \
+                                                                               \
+        size_t chunk_end = chunk + CANCEL_CHECK_INTERVAL;                      \
+        if (chunk_end > k_el_subsets->len)                                     \
+          chunk_end = k_el_subsets->len;                                       \
+                                                                               \
+        for (size_t S_idx = chunk; S_idx < chunk_end; S_idx++) {               \
+          state_t S = (state_t)k_el_subsets->buf[S_idx];                       \
+          /* if the last city is set(meaning it's the beginning), skip it */   \
+          if ((S & 1) == 0)                                                    \
+            continue;                                                          \
+                                                                               \
+          /* otherwise */                                                      \
+          /* for all cities */                                                 \
+          for (register int k = 0; k < (cities); k++) {                        \
+            /* toggle the next-th bit of subset aka remove next from the       \
+             * subset */                                                       \
+            state_t S_prime = S ^ ((state_t)1 << k);                           \
+            /* the distances from every city to k are contiguous */            \
+            const type *to_k = dists + (size_t)k * cost->stride;               \
+            /* find minimum */                                                 \
+            /* inf placeholder */                                              \
+            int64_t min = INT64_MAX;                                           \
+            for (register int m = 1; m < (cities); m++) {                      \
+              if (!is_set(S, m))                                               \
+                continue;                                                      \
+                                                                               \
+              /* separating these conditions allows for optimizations by the   \
+               * compiler source? perf */                                      \
+              if (!(m ^ k))                                                    \
+                continue;                                                      \
+                                                                               \
+              int64_t new_dist =                                               \
+                  memo_buf[((size_t)m << (cities)) | S_prime] + to_k[m];       \
+                                                                               \
+              if (new_dist < min)                                              \
+                min = new_dist;                                                \
+            }                                                                  \
+                                                                               \
+            /* cache the result */                                             \
+            memo_buf[((size_t)k << (cities)) | S] = min;                       \
+          }                                                                    \
+        }                                                                      \
+      }                                                                        \
+                                                                               \
+      if (ctl && !solve_layer_done(ctl, memo, combs, s))                       \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    return 1;                                                                  \
+  }
+
+// the body of held_karp_open, for a distance matrix with entries of type type
+#define HELD_KARP_OPEN_KERNEL(name, type)                                      \
+  static void name(DistanceMatrix_t *cost, Memo_t *memo,                       \
+                   CombinationBuffer_t *combs) {                               \
+    const type *dists = (const type *)cost->data;                              \
+    /* a path of a single city doesn't cost anything */                        \
+    for (int i = 0; i < memo->city_cnt; i++)                                   \
+      memo_at(memo, i, (int64_t)1 << i) = 0;                                   \
+                                                                               \
+    for (int s = 2; s <= memo->city_cnt; s++) {                                \
+      DynamicArray_t(int64_t) *k_el_subsets = &combs->buf[s];                  \
+      for (size_t S_idx = 0; S_idx < k_el_subsets->len; S_idx++) {             \
+        int64_t S = k_el_subsets->buf[S_idx];                                  \
+                                                                               \
+        for (int k = 0; k < memo->city_cnt; k++) {                             \
+          if (!is_set(S, k))                                                   \
+            continue;                                                          \
+                                                                               \
+          int64_t S_prime = S ^ ((int64_t)1 << k);                             \
+          const type *to_k = dists + (size_t)k * cost->stride;                 \
+          int64_t min = INT64_MAX;                                             \
+          for (int m = 0; m < memo->city_cnt; m++) {                           \
+            if (!is_set(S_prime, m))                                           \
+              continue;                                                        \
+                                                                               \
+            int64_t new_dist = memo_at(memo, m, S_prime) + to_k[m];            \
+            if (new_dist < min)                                                \
+              min = new_dist;                                                  \
+          }                                                                    \
+                                                                               \
+          memo_at(memo, k, S) = min;                                           \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }
+
+HELD_KARP_KERNEL(held_karp_tsp_i16, int16_t, memo->city_cnt, int64_t)
+HELD_KARP_KERNEL(held_karp_tsp_i32, int32_t, memo->city_cnt, int64_t)
+// the body of held_karp_repair, for a distance matrix with entries of type type
+#define HELD_KARP_REPAIR_KERNEL(name, type)                                    \
+  static uint64_t name(DistanceMatrix_t *cost, Memo_t *memo,                   \
+                       CombinationBuffer_t *combs, const uint64_t *stale,      \
+                       int stale_cnt) {                                        \
+    const type *dists = (const type *)cost->data;                              \
+    uint64_t repaired = 0;                                                     \
+    /* 2 element subsets are cheap enough to always redo */                    \
+    for (int i = 1; i < memo->city_cnt; i++)                                   \
+      memo_at(memo, i, 1 | ((int64_t)1 << i)) =                                \
+          dists[(size_t)i * cost->stride];                                     \
+                                                                               \
+    for (int s = 3; s <= memo->city_cnt; s++) {                                \
+      DynamicArray_t(int64_t) *k_el_subsets = &combs->buf[s];                  \
+      for (size_t S_idx = 0; S_idx < k_el_subsets->len; S_idx++) {             \
+        int64_t S = k_el_subsets->buf[S_idx];                                  \
+        if ((S & 1) == 0)                                                      \
+          continue;                                                            \
+                                                                               \
+        /* only subsets with both ends of a changed road are out of date */    \
+        int is_stale = 0;                                                      \
+        for (int t = 0; t < stale_cnt && !is_stale; t++)                       \
+          is_stale = ((uint64_t)S & stale[t]) == stale[t];                     \
+        if (!is_stale)                                                         \
+          continue;                                                            \
+                                                                               \
+        for (int k = 1; k < memo->city_cnt; k++) {                             \
+          if (!is_set(S, k))                                                   \
+            continue;                                                          \
+                                                                               \
+          int64_t S_prime = S ^ ((int64_t)1 << k);                             \
+          const type *to_k = dists + (size_t)k * cost->stride;                 \
+          int64_t min = INT64_MAX;                                             \
+          for (int m = 1; m < memo->city_cnt; m++) {                           \
+            if (!is_set(S_prime, m))                                           \
+              continue;                                                        \
+                                                                               \
+            int64_t new_dist = memo_at(memo, m, S_prime) + to_k[m];            \
+            if (new_dist < min)                                                \
+              min = new_dist;                                                  \
+          }                                                                    \
+                                                                               \
+          memo_at(memo, k, S) = min;                                           \
+        }                                                                      \
+        repaired++;                                                            \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    return repaired;                                                           \
+  }
+
+HELD_KARP_OPEN_KERNEL(held_karp_open_i16, int16_t)
+HELD_KARP_OPEN_KERNEL(held_karp_open_i32, int32_t)
+HELD_KARP_REPAIR_KERNEL(held_karp_repair_i16, int16_t)
+HELD_KARP_REPAIR_KERNEL(held_karp_repair_i32, int32_t)
+
+typedef int (*HeldKarpKernel_t)(DistanceMatrix_t *cost, Memo_t *memo,
+                                CombinationBuffer_t *combs,
+                                SolveControl_t *ctl);
+
+// city counts that get a kernel of their own. Smaller maps are solved in no time
+// anyways, and bigger ones don't fit in memory
+#define MIN_SIZED_KERNEL 4
+#define MAX_SIZED_KERNEL 28
+#define SIZED_KERNELS(X)                                                       \
+  X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)      \
+  X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28)
+
+// all sized subsets fit in 32 bits
+#define DECLARE_SIZED_KERNELS(n)                                               \
+  HELD_KARP_KERNEL(held_karp_tsp_##n##_i16, int16_t, n, uint32_t)              \
+  HELD_KARP_KERNEL(held_karp_tsp_##n##_i32, int32_t, n, uint32_t)
+#define SIZED_KERNEL_ENTRY(n)                                                  \
+  [n] = {held_karp_tsp_##n##_i32, held_karp_tsp_##n##_i16},
+
+SIZED_KERNELS(DECLARE_SIZED_KERNELS)
+
+// sized_kernels[n][narrow] is the kernel for n cities and the given matrix
+// entry width
+static const HeldKarpKernel_t sized_kernels[MAX_SIZED_KERNEL + 1][2] = {
+    SIZED_KERNELS(SIZED_KERNEL_ENTRY)};
+
 // populate memo with the solutions to tsp using the cost as the
 // adjacency matrix
 // Implementation of the pseudocode given here:
 // https://web.archive.org/web/20150208031521/http://www.cs.upc.edu/~mjserna/docencia/algofib/P07/dynprog.pdf
-// memo should be an initialized Memo_t object and cost should be an initialized
-// adjacency matrix
-int held_karp_tsp(DistanceMatrix_t cost, Memo_t *memo) {
-  // initialize 2 element subsets
-  for (int i = 1; i < memo->city_cnt; i++)
-    memo->dists[i][(1 | (1 << i))] = cost[0][i];
+// memo should be a Memo_t object reserved for the amount of cities, cost should
+// be an initialized adjacency matrix and combs should be generated for the
+// same amount of cities
+// ctl may be NULL. Otherwise, its stats must have gone through stats_begin if
+// it has any. Returns 0 if the solve was cancelled through ctl
+int held_karp_tsp(DistanceMatrix_t *cost, Memo_t *memo,
+                  CombinationBuffer_t *combs, SolveControl_t *ctl) {
+  int narrow = cost->narrow != 0;
+  if (memo->city_cnt >= MIN_SIZED_KERNEL && memo->city_cnt <= MAX_SIZED_KERNEL)
+    return sized_kernels[memo->city_cnt][narrow](cost, memo, combs, ctl);
+  else if (narrow)
+    return held_karp_tsp_i16(cost, memo, combs, ctl);
+  else
+    return held_karp_tsp_i32(cost, memo, combs, ctl);
+}
 
-  CombinationBuffer_t combs;
-  if (!generate_combination_matrix(&combs, memo->city_cnt))
+// like held_karp_tsp, but paths are allowed to start from any city. This fills
+// memo_at(memo, k, S) for every subset S, with the shortest path that visits
+// exactly the cities of S and ends at k.
+// Since distances are symmetric, memo_at(memo, k, all cities) is also the
+// shortest path that *starts* at k, so a single run answers every start city.
+// Arguments are the same as held_karp_tsp
+int held_karp_open(DistanceMatrix_t *cost, Memo_t *memo,
+                   CombinationBuffer_t *combs) {
+  if (cost->narrow)
+    held_karp_open_i16(cost, memo, combs);
+  else
+    held_karp_open_i32(cost, memo, combs);
+
+  return 1;
+}
+
+// bring a memo filled by held_karp_tsp up to date after some distances
+// changed. stale holds a mask with both cities of every road that changed, and
+// only subsets that contain both cities of one of them are recomputed, since
+// no other path can go through a changed road. Subsets are redone smallest
+// first, so every subset only depends on subsets that are already up to date.
+// Returns the amount of subsets that were recomputed
+uint64_t held_karp_repair(DistanceMatrix_t *cost, Memo_t *memo,
+                          CombinationBuffer_t *combs, const uint64_t *stale,
+                          int stale_cnt) {
+  if (cost->narrow)
+    return held_karp_repair_i16(cost, memo, combs, stale, stale_cnt);
+
+  return held_karp_repair_i32(cost, memo, combs, stale, stale_cnt);
+}
+
+// the body of held_karp_sparse, for a distance matrix with entries of type type
+#define HELD_KARP_SPARSE_KERNEL(name, type)                                    \
+  static void name(DistanceMatrix_t *cost, Memo_t *memo,                       \
+                   CombinationBuffer_t *combs, uint64_t *reach) {              \
+    const type *dists = (const type *)cost->data;                              \
+    uint64_t S_count = (uint64_t)1 << memo->city_cnt;                          \
+    memset(reach, 0, S_count * sizeof(uint64_t));                              \
+                                                                               \
+    /* the path only containing the first city is where everything starts */  \
+    memo_at(memo, 0, 1) = 0;                                                   \
+    reach[1] = 1;                                                              \
+                                                                               \
+    for (int s = 2; s <= memo->city_cnt; s++) {                                \
+      DynamicArray_t(int64_t) *k_el_subsets = &combs->buf[s];                  \
+      for (size_t S_idx = 0; S_idx < k_el_subsets->len; S_idx++) {             \
+        uint64_t S = (uint64_t)k_el_subsets->buf[S_idx];                       \
+        if ((S & 1) == 0)                                                      \
+          continue;                                                            \
+                                                                               \
+        uint64_t S_reach = 0;                                                  \
+        /* the first city can only ever be at the beginning */                 \
+        uint64_t ends = S & ~(uint64_t)1;                                      \
+        while (ends) {                                                         \
+          int k = __builtin_ctzll(ends);                                       \
+          ends &= ends - 1;                                                    \
+                                                                               \
+          uint64_t S_prime = S ^ ((uint64_t)1 << k);                           \
+          /* the only cities we can come from are the neighbours of k that */  \
+          /* can actually end a path over S_prime */                           \
+          uint64_t from = reach[S_prime] & cost->adj[k];                       \
+          if (!from)                                                           \
+            continue;                                                          \
+                                                                               \
+          const type *to_k = dists + (size_t)k * cost->stride;                 \
+          int64_t min = INT64_MAX;                                             \
+          while (from) {                                                       \
+            int m = __builtin_ctzll(from);                                     \
+            from &= from - 1;                                                  \
+                                                                               \
+            int64_t new_dist = memo_at(memo, m, S_prime) + to_k[m];            \
+            if (new_dist < min)                                                \
+              min = new_dist;                                                  \
+          }                                                                    \
+                                                                               \
+          memo_at(memo, k, S) = min;                                           \
+          S_reach |= (uint64_t)1 << k;                                         \
+        }                                                                      \
+                                                                               \
+        reach[S] = S_reach;                                                    \
+      }                                                                        \
+    }                                                                          \
+  }
+
+HELD_KARP_SPARSE_KERNEL(held_karp_sparse_i16, int16_t)
+HELD_KARP_SPARSE_KERNEL(held_karp_sparse_i32, int32_t)
+
+// like held_karp_tsp, but only cities connected by a line of the input file
+// are considered neighbours, instead of missing distances counting as 0.
+// Only memo entries for paths that actually exist are filled in, and bit k of
+// reach[S] is set if such a path over S ends at k. reach must have room for
+// 2^city_cnt entries.
+// Every city is only ever checked against its own neighbours, so on graphs
+// with few edges per city this is a lot faster than the regular solver.
+int held_karp_sparse(DistanceMatrix_t *cost, Memo_t *memo,
+                     CombinationBuffer_t *combs, uint64_t *reach) {
+  if (cost->narrow)
+    held_karp_sparse_i16(cost, memo, combs, reach);
+  else
+    held_karp_sparse_i32(cost, memo, combs, reach);
+
+  return 1;
+}
+
+// the sparse version of construct_tour. Fails if there is no path that visits
+// every city exactly once
+static int construct_sparse_tour(Memo_t *memo, uint64_t *reach,
+                                 DistanceMatrix_t *costs,
+                                 DynamicArray_t(int) * tour) {
+  uint64_t state = ((uint64_t)1 << memo->city_cnt) - 1;
+  // where a path over all cities can end
+  uint64_t candidates = reach[state];
+  if (memo->city_cnt > 1)
+    candidates &= ~(uint64_t)1;
+
+  if (!candidates) {
+    fprintf(stderr, "there is no path that visits every city exactly once\n");
     return 0;
+  }
 
-  // for all subsets with 3 or more elements
-  for (int s = 3; s <= memo->city_cnt; s++) {
-    DynamicArray_t(int64_t) *k_el_subsets = &combs.buf[s];
-    for (size_t S_idx = 0; S_idx < k_el_subsets->len; S_idx++) {
-      int64_t S = k_el_subsets->buf[S_idx];
-      // if the last city is set(meaning it's the beginning), skip it
-      if ((S & 1) == 0)
-        continue;
+  if (!da_init(int)(tour, memo->city_cnt))
+    return 0;
 
-      // otherwise
-      // for all cities
-      for (register int k = 0; k < memo->city_cnt; k++) {
-        // toggle the next-th bit of subset aka remove next from the subset
-        int64_t S_prime = S ^ (1 << k);
-        // find minimum
-        // inf placeholder
-        int64_t min = INT64_MAX;
-        for (register int m = 1; m < memo->city_cnt; m++) {
-          if (!is_set(S, m))
-            continue;
+  int last_idx = -1;
+  while (candidates) {
+    int idx = -1;
+    int64_t min = INT64_MAX;
+    while (candidates) {
+      int j = __builtin_ctzll(candidates);
+      candidates &= candidates - 1;
+
+      int64_t dist = memo_at(memo, j, state);
+      if (last_idx >= 0)
+        dist += dm_get(costs, j, last_idx);
+
+      if (dist < min) {
+        min = dist;
+        idx = j;
+      }
+    }
 
-          // separating these conditions allows for optimizations by the
-          // compiler source? perf
-          if (!(m ^ k))
-            continue;
+    if (!da_push(int)(tour, idx)) {
+      da_deinit(int)(tour, NULL);
+      return 0;
+    }
+
+    state ^= (uint64_t)1 << idx;
+    last_idx = idx;
+    // the previous city must be a neighbour that ends a path over the rest
+    candidates = state ? reach[state] & costs->adj[idx] : 0;
+  }
+
+  return 1;
+}
 
-          int64_t new_dist = memo->dists[m][S_prime] + cost[m][k];
+// given a memo populated by held_karp_open, reconstruct the shortest path that
+// starts at start into path. Like construct_tour, the path is stored in reverse
+// The path array must be given uninitialized and must be deinited upon
+// success by the caller.
+static int construct_open_path(Memo_t *memo, DistanceMatrix_t *costs,
+                               int start, DynamicArray_t(int) * path) {
+  int64_t state = ((int64_t)1 << memo->city_cnt) - 1;
+  int curr = start;
 
-          if (new_dist < min)
-            min = new_dist;
-        }
+  if (!da_init(int)(path, memo->city_cnt))
+    return 0;
+
+  // walking back from the end of the path towards its beginning is the same as
+  // walking from start, since the path can be reversed
+  while (1) {
+    if (!da_push(int)(path, curr)) {
+      da_deinit(int)(path, NULL);
+      return 0;
+    }
+
+    state ^= (int64_t)1 << curr;
+    if (state == 0)
+      break;
+
+    int next = -1;
+    int64_t min = INT64_MAX;
+    for (int j = 0; j < memo->city_cnt; j++) {
+      if (!is_set(state, j))
+        continue;
 
-        // cache the result
-        memo->dists[k][S] = min;
+      int64_t dist = memo_at(memo, j, state) + dm_get(costs, j, curr);
+      if (dist < min) {
+        min = dist;
+        next = j;
       }
     }
+
+    curr = next;
   }
 
-  // delete the combinations array
-  da_deinit(DynamicArray_t(int64_t))(&combs, int64_arr_destroy);
+  // we pushed cities in visiting order, but routes are stored in reverse
+  for (size_t i = 0; i < path->len / 2; i++) {
+    int tmp = path->buf[i];
+    path->buf[i] = path->buf[path->len - 1 - i];
+    path->buf[path->len - 1 - i] = tmp;
+  }
 
   return 1;
 }
 
 // given a populated memo object, use it to reconstruct the optimal tsp tour,
-// into the tour array
+// into the tour array. If closed is set, the tour must also return to the
+// starting city.
 // The tour array must be given uninitialized, will be populated with the
 // results and must be deinited upon success by the caller.
-static int construct_tour(Memo_t *memo, DistanceMatrix_t costs,
-                          DynamicArray_t(int) * tour) {
-  int last_idx = -1;
-  int64_t state = (1 << memo->city_cnt) - 1;
+static int construct_tour(Memo_t *memo, DistanceMatrix_t *costs,
+                          DynamicArray_t(int) * tour, int closed) {
+  // a closed tour behaves as if the starting city came after the last one
+  int last_idx = closed ? 0 : -1;
+  int64_t state = ((int64_t)1 << memo->city_cnt) - 1;
 
   if (!da_init(int)(tour, memo->city_cnt))
     return 0;
@@ -334,12 +1357,12 @@ static int construct_tour(Memo_t *memo, DistanceMatrix_t costs,
       int64_t prev, new;
       if (last_idx < 0) {
         // only on the first run, we find the total minimum
-        prev = memo->dists[idx][state];
-        new = memo->dists[j][state];
+        prev = memo_at(memo, idx, state);
+        new = memo_at(memo, j, state);
       } else {
         // otherwise we find the minimum when compared to the old value
-        prev = memo->dists[idx][state] + costs[idx][last_idx];
-        new = memo->dists[j][state] + costs[j][last_idx];
+        prev = memo_at(memo, idx, state) + dm_get(costs, idx, last_idx);
+        new = memo_at(memo, j, state) + dm_get(costs, j, last_idx);
       }
 
       if (new < prev)
@@ -353,7 +1376,7 @@ static int construct_tour(Memo_t *memo, DistanceMatrix_t costs,
     }
 
     // update the current subset
-    state ^= (1 << idx);
+    state ^= (int64_t)1 << idx;
     last_idx = idx;
   }
 
@@ -365,105 +1388,2166 @@ static int construct_tour(Memo_t *memo, DistanceMatrix_t costs,
   return 1;
 }
 
-static void print_results(DynamicArray_t(int) * route,
-                          DynamicArray_t(Str_t) * cities,
-                          DistanceMatrix_t costs) {
-  printf("We will visit cities in the following order:\n");
-  // total cost accumulator
-  int64_t cost = 0;
-  for (int i = (int)route->len - 1; i >= 0; i--) {
-    int curr_idx = route->buf[i];
-    ss_print(stdout, cities->buf[curr_idx]);
-    // for all elements except the last one
-    if (i == 0)
-      continue;
-
-    // distance to previous element
-    int32_t curr_cost = costs[curr_idx][route->buf[i - 1]];
-    // print its distance to it's previous element
-    printf(" -(%" PRId32 ")-> ", curr_cost);
-    // and add it to the accumulator
-    cost += curr_cost;
+// the position of subset S among all subsets of the same size in colex order.
+// Colex order is the same as the numeric order of the masks, so ranks are
+// exactly the order in which next_subset walks them
+static uint64_t colex_rank(uint64_t S) {
+  uint64_t rank = 0;
+  for (int i = 1; S; i++) {
+    rank += binom[__builtin_ctzll(S)][i];
+    S &= S - 1;
   }
-  printf("\n");
 
-  printf("Total cost: %" PRId64 "\n", cost);
+  return rank;
 }
 
-int main(int argc, const char **argv) {
-  if (argc != 2)
-    return print_usage(argv[0]);
+// the subset of size s with the given rank
+static uint64_t colex_unrank(uint64_t rank, int s) {
+  uint64_t S = 0;
+  for (int i = s; i >= 1; i--) {
+    int p = i - 1;
+    while (binom[p + 1][i] <= rank)
+      p++;
 
-  FILE *input_map = fopen(argv[1], "r");
-  if (!input_map) {
-    perror("could not open input file");
-    return 1;
+    S |= (uint64_t)1 << p;
+    rank -= binom[p][i];
   }
 
-  Str_t file_data = {0};
-  int read_res = read_input(input_map, &file_data);
+  return S;
+}
 
-  if (fclose(input_map) != 0) {
-    perror("could not close input file");
-    // if it's null nothing happens according to man page
-    free((void *)file_data.s);
-    return 1;
-  }
+// the next subset of the same size, in colex order(Gosper's hack)
+static uint64_t next_subset(uint64_t S) {
+  if (!S)
+    return 0;
 
-  if (!read_res) {
-    free((char *)file_data.s);
-    return 1;
+  uint64_t lowest = S & -S;
+  uint64_t ripple = S + lowest;
+  return (((ripple ^ S) >> 2) / lowest) | ripple;
+}
+
+// a single cardinality layer of one of the two half tables.
+// Row r holds one entry for every city of the subset with rank r, in
+// increasing order. parents holds, for every entry, the city that comes before
+// the last one, or MITM_NO_PARENT if there is none
+typedef struct {
+  int64_t *dists;
+  uint8_t *parents;
+  uint64_t count;
+  int s;
+} MitmLayer_t;
+
+#define MITM_NO_PARENT UINT8_MAX
+// layers with less subsets than this are not split between threads
+#define MITM_MIN_PARTITION 4096
+
+// Subsets only ever contain cities 1 to n - 1, since city 0 always starts the
+// path. Bit i of a subset stands for city i + 1
+typedef struct {
+  int32_t dist[MAX_CITIES][MAX_CITIES];
+  // the amount of cities excluding city 0
+  int m;
+  // prefix and suffix lengths
+  int a, b;
+  // forward[s] are the paths that start at 0, visit exactly the s cities of a
+  // subset and end at each one of them
+  MitmLayer_t forward[MAX_CITIES];
+  // backward[s] are the paths that visit exactly the s cities of a subset,
+  // starting anywhere and ending at each one of them. By symmetry, that's the
+  // same as starting there
+  MitmLayer_t backward[MAX_CITIES];
+  // if not NULL, the solve stops as soon as this becomes non zero
+  const int *cancel;
+} Mitm_t;
+
+static int mitm_cancelled(const Mitm_t *ctx) {
+  return ctx->cancel && __atomic_load_n(ctx->cancel, __ATOMIC_RELAXED);
+}
+
+// the work a single thread does over a range of ranks
+typedef struct {
+  Mitm_t *ctx;
+  MitmLayer_t *prev, *cur;
+  uint64_t from, to;
+  // only used by joins
+  int64_t best;
+  uint64_t best_rank;
+  int best_k, best_j;
+} MitmJob_t;
+
+static void *alloc_array(uint64_t count, size_t el_sz) {
+  if (count > SIZE_MAX / el_sz)
+    return NULL;
+
+  return malloc((size_t)(count > 0 ? count : 1) * el_sz);
+}
+
+// compute the rows of cur in [from, to) from prev. If prev is NULL, cur is the
+// first layer
+static void *mitm_layer_job(void *arg) {
+  MitmJob_t *job = (MitmJob_t *)arg;
+  Mitm_t *ctx = job->ctx;
+  MitmLayer_t *cur = job->cur;
+  int s = cur->s;
+  int forward = cur == &ctx->forward[s];
+
+  uint64_t S = colex_unrank(job->from, s);
+  for (uint64_t r = job->from; r < job->to; r++, S = next_subset(S)) {
+    if ((r - job->from) % CANCEL_CHECK_INTERVAL == 0 && mitm_cancelled(ctx))
+      return NULL;
+
+    int64_t *row = cur->dists + r * s;
+    uint8_t *parents = cur->parents + r * s;
+
+    if (!job->prev) {
+      int k = __builtin_ctzll(S) + 1;
+      // forward paths come from city 0, backward ones start right here
+      row[0] = forward ? ctx->dist[0][k] : 0;
+      parents[0] = MITM_NO_PARENT;
+      continue;
+    }
+
+    int p[MAX_CITIES];
+    uint64_t bits = S;
+    for (int i = 0; i < s; i++) {
+      p[i] = __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+
+    // the rank of S without its j-th city is lo[j] + hi[j], since every city
+    // after the removed one moves one position down
+    uint64_t lo[MAX_CITIES], hi[MAX_CITIES];
+    lo[0] = 0;
+    for (int i = 1; i < s; i++)
+      lo[i] = lo[i - 1] + binom[p[i - 1]][i];
+
+    hi[s - 1] = 0;
+    for (int i = s - 2; i >= 0; i--)
+      hi[i] = hi[i + 1] + binom[p[i + 1]][i + 1];
+
+    for (int j = 0; j < s; j++) {
+      int k = p[j] + 1;
+      const int64_t *prev_row = job->prev->dists + (lo[j] + hi[j]) * (s - 1);
+
+      int64_t min = INT64_MAX;
+      int parent = 0;
+      for (int t = 0; t < s - 1; t++) {
+        int i = p[t < j ? t : t + 1];
+        int64_t new_dist = prev_row[t] + ctx->dist[i + 1][k];
+        if (new_dist < min) {
+          min = new_dist;
+          parent = i;
+        }
+      }
+
+      row[j] = min;
+      parents[j] = (uint8_t)parent;
+    }
+  }
+
+  return NULL;
+}
+
+// find the cheapest way to glue together a forward path over a subset in
+// [from, to) with a backward path over the rest of the cities
+static void *mitm_join_job(void *arg) {
+  MitmJob_t *job = (MitmJob_t *)arg;
+  Mitm_t *ctx = job->ctx;
+  MitmLayer_t *front = &ctx->forward[ctx->a];
+  MitmLayer_t *back = &ctx->backward[ctx->b];
+  uint64_t all = ((uint64_t)1 << ctx->m) - 1;
+
+  job->best = INT64_MAX;
+  uint64_t A = colex_unrank(job->from, ctx->a);
+  for (uint64_t r = job->from; r < job->to; r++, A = next_subset(A)) {
+    if ((r - job->from) % CANCEL_CHECK_INTERVAL == 0 && mitm_cancelled(ctx))
+      return NULL;
+
+    uint64_t B = all ^ A;
+    // taking the complement reverses colex order, so both tables are read
+    // sequentially without ever ranking B
+    uint64_t rank_b = back->count - 1 - r;
+    const int64_t *back_row = back->dists + rank_b * ctx->b;
+
+    // a prefix without any cities besides 0 just ends at 0
+    int front_cities[MAX_CITIES];
+    int64_t front_dists[MAX_CITIES];
+    int front_cnt = 0;
+    if (ctx->a == 0) {
+      front_cities[0] = 0;
+      front_dists[0] = 0;
+      front_cnt = 1;
+    } else {
+      const int64_t *front_row = front->dists + r * ctx->a;
+      for (uint64_t bits = A; bits; bits &= bits - 1) {
+        front_cities[front_cnt] = __builtin_ctzll(bits) + 1;
+        front_dists[front_cnt] = front_row[front_cnt];
+        front_cnt++;
+      }
+    }
+
+    int t = 0;
+    for (uint64_t bits = B; bits; bits &= bits - 1, t++) {
+      int j = __builtin_ctzll(bits) + 1;
+      for (int f = 0; f < front_cnt; f++) {
+        int64_t total =
+            front_dists[f] + ctx->dist[front_cities[f]][j] + back_row[t];
+        if (total < job->best) {
+          job->best = total;
+          job->best_rank = r;
+          job->best_k = f;
+          job->best_j = t;
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// run fn over all ranks in [0, count), split into partitions that each run on
+// their own thread. jobs must have room for MAX_SOLVE_THREADS entries and
+// have everything but their range filled in. Returns the amount of jobs used
+static size_t mitm_run(void *(*fn)(void *), MitmJob_t *jobs, uint64_t count) {
+  size_t job_cnt = solve_thread_count();
+  if (count / MITM_MIN_PARTITION < job_cnt)
+    job_cnt = count / MITM_MIN_PARTITION > 0 ? count / MITM_MIN_PARTITION : 1;
+
+  for (size_t i = 0; i < job_cnt; i++) {
+    jobs[i] = jobs[0];
+    jobs[i].from = count / job_cnt * i;
+    jobs[i].to = i == job_cnt - 1 ? count : count / job_cnt * (i + 1);
+  }
+
+  pthread_t threads[MAX_SOLVE_THREADS];
+  int spawned[MAX_SOLVE_THREADS] = {0};
+  for (size_t i = 1; i < job_cnt; i++)
+    spawned[i] = pthread_create(&threads[i], NULL, fn, &jobs[i]) == 0;
+
+  fn(&jobs[0]);
+
+  for (size_t i = 1; i < job_cnt; i++) {
+    // if we couldn't get a thread, we just do the work ourselves
+    if (spawned[i])
+      pthread_join(threads[i], NULL);
+    else
+      fn(&jobs[i]);
+  }
+
+  return job_cnt;
+}
+
+// compute layers 1 to last of one of the half tables. Only the distances of
+// the last layer are kept around, but all parents are
+static int mitm_half(Mitm_t *ctx, MitmLayer_t *layers, int last) {
+  MitmJob_t jobs[MAX_SOLVE_THREADS];
+  for (int s = 1; s <= last; s++) {
+    MitmLayer_t *cur = &layers[s];
+    cur->s = s;
+    cur->count = binom[ctx->m][s];
+    cur->dists = (int64_t *)alloc_array(cur->count * s, sizeof(int64_t));
+    cur->parents = (uint8_t *)alloc_array(cur->count * s, sizeof(uint8_t));
+    if (!cur->dists || !cur->parents) {
+      solver_error("could not allocate meet in the middle tables\n");
+      return 0;
+    }
+
+    jobs[0] = (MitmJob_t){
+        .ctx = ctx, .prev = s > 1 ? &layers[s - 1] : NULL, .cur = cur};
+    mitm_run(mitm_layer_job, jobs, cur->count);
+    if (mitm_cancelled(ctx))
+      return 0;
+
+    // we are done with the previous layer
+    if (s > 1) {
+      free(layers[s - 1].dists);
+      layers[s - 1].dists = NULL;
+    }
+  }
+
+  return 1;
+}
+
+static void mitm_deinit(Mitm_t *ctx) {
+  for (int s = 0; s < MAX_CITIES; s++) {
+    free(ctx->forward[s].dists);
+    free(ctx->forward[s].parents);
+    free(ctx->backward[s].dists);
+    free(ctx->backward[s].parents);
+  }
+}
+
+// follow the parents of layers from the city at position pos of the subset S
+// of size s, appending every city along the way to path
+static int mitm_walk(MitmLayer_t *layers, int s, uint64_t S, int pos,
+                     DynamicArray_t(int) * path) {
+  for (; s >= 1; s--) {
+    uint64_t bits = S;
+    for (int i = 0; i < pos; i++)
+      bits &= bits - 1;
+
+    int city = __builtin_ctzll(bits);
+    if (!da_push(int)(path, city + 1))
+      return 0;
+
+    uint8_t parent = layers[s].parents[colex_rank(S) * s + pos];
+    if (parent == MITM_NO_PARENT)
+      break;
+
+    S ^= (uint64_t)1 << city;
+    pos = __builtin_popcountll(S & (((uint64_t)1 << parent) - 1));
+  }
+
+  return 1;
+}
+
+// solve costs exactly by meeting in the middle. Paths from city 0 over half of
+// the other cities are joined with paths over the rest, so only subsets of up
+// to half of the cities ever get stored
+// If cancel is not NULL, the solve fails as soon as it becomes non zero
+// The route array must be given uninitialized and must be deinited upon
+// success by the caller
+static int held_karp_mitm(DistanceMatrix_t *costs, const int *cancel,
+                          DynamicArray_t(int) * route) {
+  pthread_once(&binom_once, init_binom);
+
+  Mitm_t *ctx = (Mitm_t *)calloc(1, sizeof(Mitm_t));
+  if (!ctx) {
+    solver_perror("could not allocate meet in the middle context");
+    return 0;
+  }
+
+  int n = costs->city_cnt;
+  ctx->m = n - 1;
+  ctx->a = ctx->m / 2;
+  ctx->b = ctx->m - ctx->a;
+  ctx->cancel = cancel;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      ctx->dist[i][j] = dm_get(costs, i, j);
+
+  if (!da_init(int)(route, n)) {
+    free(ctx);
+    return 0;
+  }
+
+  // a single city is its own path
+  if (ctx->m == 0) {
+    da_push(int)(route, 0);
+    free(ctx);
+    return 1;
+  }
+
+  if (!mitm_half(ctx, ctx->forward, ctx->a) ||
+      !mitm_half(ctx, ctx->backward, ctx->b)) {
+    da_deinit(int)(route, NULL);
+    mitm_deinit(ctx);
+    free(ctx);
+    return 0;
+  }
+
+  MitmJob_t jobs[MAX_SOLVE_THREADS];
+  jobs[0] = (MitmJob_t){.ctx = ctx};
+  size_t job_cnt = mitm_run(mitm_join_job, jobs, binom[ctx->m][ctx->a]);
+  if (mitm_cancelled(ctx)) {
+    da_deinit(int)(route, NULL);
+    mitm_deinit(ctx);
+    free(ctx);
+    return 0;
+  }
+
+  MitmJob_t *best = &jobs[0];
+  for (size_t i = 1; i < job_cnt; i++)
+    if (jobs[i].best < best->best)
+      best = &jobs[i];
+
+  uint64_t A = colex_unrank(best->best_rank, ctx->a);
+  uint64_t B = (((uint64_t)1 << ctx->m) - 1) ^ A;
+
+  // routes are stored back to front, so the suffix goes first, reversed
+  int ok = mitm_walk(ctx->backward, ctx->b, B, best->best_j, route);
+  for (size_t i = 0; ok && i < route->len / 2; i++) {
+    int tmp = route->buf[i];
+    route->buf[i] = route->buf[route->len - 1 - i];
+    route->buf[route->len - 1 - i] = tmp;
+  }
+
+  // the forward parents already lead back to city 0
+  if (ok && ctx->a > 0)
+    ok = mitm_walk(ctx->forward, ctx->a, A, best->best_k, route);
+  if (ok)
+    ok = da_push(int)(route, 0);
+
+  if (!ok)
+    da_deinit(int)(route, NULL);
+
+  mitm_deinit(ctx);
+  free(ctx);
+  return ok;
+}
+
+// the total distance travelled along route. If closed is set, this includes
+// the way back to the first city
+static int64_t route_cost(DynamicArray_t(int) * route, DistanceMatrix_t *costs,
+                          int closed) {
+  int64_t cost = 0;
+  for (size_t i = 1; i < route->len; i++)
+    cost += dm_get(costs, route->buf[i], route->buf[i - 1]);
+
+  if (closed && route->len > 1)
+    cost += dm_get(costs, route->buf[0], route->buf[route->len - 1]);
+
+  return cost;
+}
+
+static void print_results(FILE *out, DynamicArray_t(int) * route,
+                          DynamicArray_t(Str_t) * cities,
+                          DistanceMatrix_t *costs) {
+  fprintf(out, "We will visit cities in the following order:\n");
+  // total cost accumulator
+  int64_t cost = 0;
+  for (int i = (int)route->len - 1; i >= 0; i--) {
+    int curr_idx = route->buf[i];
+    ss_print(out, cities->buf[curr_idx]);
+    // for all elements except the last one
+    if (i == 0)
+      continue;
+
+    // distance to previous element
+    int32_t curr_cost = dm_get(costs, curr_idx, route->buf[i - 1]);
+    // print its distance to it's previous element
+    fprintf(out, " -(%" PRId32 ")-> ", curr_cost);
+    // and add it to the accumulator
+    cost += curr_cost;
+  }
+  fprintf(out, "\n");
+
+  fprintf(out, "Total cost: %" PRId64 "\n", cost);
+}
+
+// Compiled maps are a header, followed by a CompiledName_t for every city, the
+// city names, the adjacency masks and finally the distance matrix, exactly as
+// it is laid out in memory, starting at a DM_ALIGN aligned offset. Since
+// mappings are page aligned, the matrix can be used right out of the mapping.
+// Everything is in native byte order
+#define COMPILED_MAGIC "JABBAMAP"
+#define COMPILED_VERSION 1
+#define COMPILED_BYTE_ORDER 0x01020304u
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  // COMPILED_BYTE_ORDER, as written by the machine that compiled the map
+  uint32_t byte_order;
+  uint32_t city_cnt;
+  uint32_t narrow;
+  uint64_t stride;
+  // offsets from the start of the file
+  uint64_t names_off;
+  uint64_t adj_off;
+  uint64_t matrix_off;
+  uint64_t file_sz;
+} CompiledHeader_t;
+
+typedef struct {
+  // from the start of the file
+  uint32_t off;
+  uint32_t len;
+} CompiledName_t;
+
+static int is_compiled_map(Str_t data) {
+  return data.len >= sizeof(CompiledHeader_t) &&
+         memcmp(data.s, COMPILED_MAGIC, strlen(COMPILED_MAGIC)) == 0;
+}
+
+// the size of the distance matrix of a compiled map
+static uint64_t compiled_matrix_sz(uint64_t city_cnt, uint64_t stride,
+                                   int narrow) {
+  return stride * city_cnt * (narrow ? sizeof(int16_t) : sizeof(int32_t));
+}
+
+// the compiled version of parse_input. Nothing is copied except for the names
+// array, costs_out ends up pointing into data
+static int load_compiled_map(Str_t data, DynamicArray_t(Str_t) * cities,
+                             DistanceMatrix_t *costs_out) {
+  CompiledHeader_t header;
+  memcpy(&header, data.s, sizeof(header));
+
+  if (header.version != COMPILED_VERSION ||
+      header.byte_order != COMPILED_BYTE_ORDER) {
+    fprintf(stderr, "compiled map was made by a different version of "
+                    "jabbamaps or on a different machine\n");
+    return 0;
+  }
+
+  uint64_t names_end =
+      header.names_off + (uint64_t)header.city_cnt * sizeof(CompiledName_t);
+  if (header.city_cnt > MAX_CITIES || header.narrow > 1 ||
+      header.stride < header.city_cnt || header.stride > MAX_CITIES + DM_ALIGN ||
+      header.file_sz != data.len || header.names_off > data.len ||
+      names_end > data.len || header.adj_off > data.len ||
+      header.adj_off + header.city_cnt * sizeof(uint64_t) > data.len ||
+      header.matrix_off % DM_ALIGN != 0 || header.matrix_off > data.len ||
+      compiled_matrix_sz(header.city_cnt, header.stride, header.narrow) >
+          data.len - header.matrix_off) {
+    fprintf(stderr, "compiled map is corrupted\n");
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < header.city_cnt; i++) {
+    CompiledName_t name;
+    memcpy(&name, data.s + header.names_off + i * sizeof(CompiledName_t),
+           sizeof(name));
+    if ((uint64_t)name.off + name.len > data.len) {
+      fprintf(stderr, "compiled map is corrupted\n");
+      return 0;
+    }
+
+    Str_t city = {.s = data.s + name.off, .len = name.len};
+    if (!da_push(Str_t)(cities, city))
+      return 0;
+  }
+
+  memset(costs_out, 0, sizeof(DistanceMatrix_t));
+  memcpy(costs_out->adj, data.s + header.adj_off,
+         header.city_cnt * sizeof(uint64_t));
+  costs_out->data = (void *)(data.s + header.matrix_off);
+  costs_out->stride = (size_t)header.stride;
+  costs_out->city_cnt = (int)header.city_cnt;
+  costs_out->narrow = (int)header.narrow;
+  costs_out->borrowed = 1;
+  return 1;
+}
+
+// write zeros to out until its position is a multiple of align
+static int pad_to(FILE *out, uint64_t *pos, uint64_t align) {
+  static const char zeros[DM_ALIGN] = {0};
+  uint64_t padding = (align - *pos % align) % align;
+  *pos += padding;
+  return fwrite(zeros, 1, (size_t)padding, out) == padding;
+}
+
+// write a parsed map as a compiled map into out
+static int write_compiled_map(DynamicArray_t(Str_t) * cities,
+                              DistanceMatrix_t *costs, FILE *out) {
+  uint32_t city_cnt = (uint32_t)cities->len;
+  CompiledHeader_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPILED_MAGIC, sizeof(header.magic));
+  header.version = COMPILED_VERSION;
+  header.byte_order = COMPILED_BYTE_ORDER;
+  header.city_cnt = city_cnt;
+  header.narrow = (uint32_t)costs->narrow;
+  header.stride = costs->stride;
+
+  // lay out the file before writing anything, so the header is complete
+  uint64_t pos = sizeof(header);
+  header.names_off = pos;
+  pos += city_cnt * sizeof(CompiledName_t);
+  uint64_t text_off = pos;
+  for (uint32_t i = 0; i < city_cnt; i++)
+    pos += cities->buf[i].len;
+  pos += (sizeof(uint64_t) - pos % sizeof(uint64_t)) % sizeof(uint64_t);
+  header.adj_off = pos;
+  pos += city_cnt * sizeof(uint64_t);
+  pos += (DM_ALIGN - pos % DM_ALIGN) % DM_ALIGN;
+  header.matrix_off = pos;
+  uint64_t matrix_sz =
+      compiled_matrix_sz(city_cnt, costs->stride, costs->narrow);
+  header.file_sz = pos + matrix_sz;
+
+  if (header.file_sz > UINT32_MAX) {
+    fprintf(stderr, "map is too big to compile\n");
+    return 0;
+  }
+
+  int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  uint64_t off = text_off;
+  for (uint32_t i = 0; ok && i < city_cnt; i++) {
+    CompiledName_t name = {.off = (uint32_t)off,
+                           .len = (uint32_t)cities->buf[i].len};
+    ok = fwrite(&name, sizeof(name), 1, out) == 1;
+    off += name.len;
+  }
+
+  for (uint32_t i = 0; ok && i < city_cnt; i++)
+    ok = fwrite(cities->buf[i].s, 1, cities->buf[i].len, out) ==
+         cities->buf[i].len;
+
+  pos = off;
+  ok = ok && pad_to(out, &pos, sizeof(uint64_t)) &&
+       fwrite(costs->adj, sizeof(uint64_t), city_cnt, out) == city_cnt;
+  pos += city_cnt * sizeof(uint64_t);
+  ok = ok && pad_to(out, &pos, DM_ALIGN) &&
+       fwrite(costs->data, 1, (size_t)matrix_sz, out) == matrix_sz;
+
+  if (!ok)
+    perror("could not write compiled map");
+
+  return ok;
+}
+
+// a parsed input file. The city names point into data
+typedef struct {
+  Str_t data;
+  DynamicArray_t(Str_t) cities;
+  DistanceMatrix_t costs;
+} Map_t;
+
+// read and parse the file called filename into map
+// Upon success, the caller is responsible for calling map_deinit
+static int map_load(const char *filename, Map_t *map) {
+  if (!mmap_file(filename, &map->data))
+    return 0;
+
+  if (!da_init(Str_t)(&map->cities, 16)) {
+    munmap_file(map->data);
+    return 0;
+  }
+
+  // compiled maps are used as they are
+  int parsed = is_compiled_map(map->data)
+                   ? load_compiled_map(map->data, &map->cities, &map->costs)
+                   : parse_input(map->data, &map->cities, &map->costs);
+  if (!parsed) {
+    da_deinit(Str_t)(&map->cities, NULL);
+    munmap_file(map->data);
+    return 0;
+  }
+
+  if (map->cities.len == 0) {
+    fprintf(stderr, "input file does not contain any cities\n");
+    dm_deinit(&map->costs);
+    da_deinit(Str_t)(&map->cities, NULL);
+    munmap_file(map->data);
+    return 0;
+  }
+
+  return 1;
+}
+
+static void map_deinit(Map_t *map) {
+  dm_deinit(&map->costs);
+  da_deinit(Str_t)(&map->cities, NULL);
+  munmap_file(map->data);
+}
+
+// solved maps are kept in a cache file made of a header followed by
+// CACHE_SETS * CACHE_WAYS fixed size entries. A map can only live in one set,
+// picked by its key, and when the set is full the least recently used entry is
+// replaced. The file never grows, so it is mapped as is
+#define CACHE_MAGIC "JBMCACHE"
+#define CACHE_VERSION 1
+#define CACHE_SETS 4096
+#define CACHE_WAYS 8
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t sets;
+  uint32_t ways;
+  uint32_t entry_sz;
+  // bumped every time an entry is used, see CacheEntry_t.stamp
+  uint64_t clock;
+  // keep the entries cache line aligned
+  uint8_t pad[32];
+} CacheHeader_t;
+
+typedef struct {
+  uint64_t key[2];
+  // the clock at the last time this entry was used, 0 if the entry is empty
+  uint64_t stamp;
+  int64_t cost;
+  uint8_t city_cnt;
+  uint8_t sparse;
+  // the route, in canonical city indices and the same order as a route array
+  uint8_t tour[MAX_CITIES];
+  uint8_t pad[30];
+} CacheEntry_t;
+
+typedef struct {
+  int fd;
+  CacheHeader_t *header;
+  CacheEntry_t *entries;
+  size_t size;
+  // flock only keeps other processes out, so threads need this as well
+  pthread_mutex_t lock;
+} SolutionCache_t;
+
+// the identity of a map, the same for all maps that only differ in the names
+// and order of the cities after the first one
+typedef struct {
+  uint64_t hash[2];
+  // order[i] is the original index of canonical city i
+  int order[MAX_CITIES];
+  int city_cnt;
+  int sparse;
+} CacheKey_t;
+
+// the weight of the road from i to j, or INT64_MIN if a sparse map doesn't
+// have one
+static int64_t cache_weight(DistanceMatrix_t *costs, int sparse, int i,
+                            int j) {
+  if (sparse && !(costs->adj[i] & ((uint64_t)1 << j)))
+    return INT64_MIN;
+
+  return dm_get(costs, i, j);
+}
+
+static int cmp_int64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// splitmix64's finalizer
+static uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// whether signature a comes before b, both of length n
+static int signature_less(const int64_t *a, const int64_t *b, int n) {
+  for (int i = 0; i < n; i++)
+    if (a[i] != b[i])
+      return a[i] < b[i];
+
+  return 0;
+}
+
+// compute the key of costs. The first city stays first, since that's where the
+// route starts, and the rest are sorted by their distance to it followed by
+// all of their other distances, in increasing order. Cities that can't be told
+// apart keep their original order, which can only cause a miss, never a wrong
+// hit, since the hash covers the whole reordered matrix
+static void cache_key(DistanceMatrix_t *costs, int sparse, CacheKey_t *key) {
+  int n = costs->city_cnt;
+  int64_t signatures[MAX_CITIES][MAX_CITIES];
+  for (int i = 0; i < n; i++) {
+    signatures[i][0] = cache_weight(costs, sparse, 0, i);
+    int len = 1;
+    for (int j = 0; j < n; j++)
+      if (j != i)
+        signatures[i][len++] = cache_weight(costs, sparse, i, j);
+    qsort(&signatures[i][1], (size_t)len - 1, sizeof(int64_t), cmp_int64);
+  }
+
+  key->city_cnt = n;
+  key->sparse = sparse;
+  for (int i = 0; i < n; i++)
+    key->order[i] = i;
+
+  // insertion sort is stable and there are at most 64 cities anyways
+  for (int i = 2; i < n; i++) {
+    int city = key->order[i];
+    int j = i;
+    for (; j > 1 && signature_less(signatures[city],
+                                   signatures[key->order[j - 1]], n);
+         j--)
+      key->order[j] = key->order[j - 1];
+
+    key->order[j] = city;
+  }
+
+  uint64_t h1 = mix64((uint64_t)n * 2 + (uint64_t)sparse);
+  uint64_t h2 = mix64(h1 ^ 0x9E3779B97F4A7C15ull);
+  for (int i = 0; i < n; i++) {
+    for (int j = i + 1; j < n; j++) {
+      uint64_t w = (uint64_t)cache_weight(costs, sparse, key->order[i],
+                                          key->order[j]);
+      h1 = mix64(h1 ^ w) * 0x100000001B3ull;
+      h2 = mix64(h2 + w + 0x632BE59BD9B4E019ull);
+    }
+  }
+
+  key->hash[0] = h1;
+  key->hash[1] = h2;
+}
+
+// open the cache file called path, creating it if it doesn't exist
+// Upon success, the caller is responsible for calling cache_close
+static int cache_open(const char *path, SolutionCache_t *cache) {
+  size_t size = sizeof(CacheHeader_t) +
+                (size_t)CACHE_SETS * CACHE_WAYS * sizeof(CacheEntry_t);
+
+  cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (cache->fd < 0) {
+    perror("could not open cache file");
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(cache->fd, &st) != 0) {
+    perror("could not stat cache file");
+    close(cache->fd);
+    return 0;
+  }
+
+  // a new file, whose entries are all empty since the file is zero filled
+  int fresh = st.st_size == 0;
+  if (fresh && ftruncate(cache->fd, (off_t)size) != 0) {
+    perror("could not size cache file");
+    close(cache->fd);
+    return 0;
+  }
+
+  if (!fresh && (size_t)st.st_size != size) {
+    fprintf(stderr, "%s is not a cache file\n", path);
+    close(cache->fd);
+    return 0;
+  }
+
+  void *data =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+  if (data == MAP_FAILED) {
+    perror("could not map cache file");
+    close(cache->fd);
+    return 0;
+  }
+
+  cache->header = (CacheHeader_t *)data;
+  cache->entries = (CacheEntry_t *)((char *)data + sizeof(CacheHeader_t));
+  cache->size = size;
+
+  if (fresh) {
+    memcpy(cache->header->magic, CACHE_MAGIC, sizeof(cache->header->magic));
+    cache->header->version = CACHE_VERSION;
+    cache->header->sets = CACHE_SETS;
+    cache->header->ways = CACHE_WAYS;
+    cache->header->entry_sz = sizeof(CacheEntry_t);
+  } else if (memcmp(cache->header->magic, CACHE_MAGIC,
+                    sizeof(cache->header->magic)) != 0 ||
+             cache->header->version != CACHE_VERSION ||
+             cache->header->sets != CACHE_SETS ||
+             cache->header->ways != CACHE_WAYS ||
+             cache->header->entry_sz != sizeof(CacheEntry_t)) {
+    fprintf(stderr, "%s is not a cache file\n", path);
+    munmap(data, size);
+    close(cache->fd);
+    return 0;
+  }
+
+  pthread_mutex_init(&cache->lock, NULL);
+  return 1;
+}
+
+static void cache_close(SolutionCache_t *cache) {
+  pthread_mutex_destroy(&cache->lock);
+  munmap(cache->header, cache->size);
+  close(cache->fd);
+}
+
+static void cache_lock(SolutionCache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  flock(cache->fd, LOCK_EX);
+}
+
+static void cache_unlock(SolutionCache_t *cache) {
+  flock(cache->fd, LOCK_UN);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static CacheEntry_t *cache_set(SolutionCache_t *cache, CacheKey_t *key) {
+  return &cache->entries[(key->hash[0] % CACHE_SETS) * CACHE_WAYS];
+}
+
+// look key up in cache and, if it's there, store its route, translated to the
+// original city indices, into route
+// The route array must be given uninitialized and must be deinited by the
+// caller if this returns 1
+static int cache_lookup(SolutionCache_t *cache, CacheKey_t *key,
+                        DistanceMatrix_t *costs, DynamicArray_t(int) * route) {
+  cache_lock(cache);
+  CacheEntry_t *set = cache_set(cache, key);
+  CacheEntry_t *hit = NULL;
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    CacheEntry_t *entry = &set[way];
+    if (entry->stamp != 0 && entry->key[0] == key->hash[0] &&
+        entry->key[1] == key->hash[1] && entry->city_cnt == key->city_cnt &&
+        entry->sparse == key->sparse) {
+      hit = entry;
+      break;
+    }
+  }
+
+  int found = 0;
+  if (hit && da_init(int)(route, key->city_cnt)) {
+    found = 1;
+    // every city has to be visited exactly once
+    uint64_t seen = 0;
+    for (int i = 0; i < key->city_cnt && found; i++) {
+      found = hit->tour[i] < key->city_cnt &&
+              !(seen & ((uint64_t)1 << hit->tour[i])) &&
+              da_push(int)(route, key->order[hit->tour[i]]);
+      seen |= (uint64_t)1 << hit->tour[i];
+    }
+
+    // routes always end back at the first city
+    if (found && route->buf[route->len - 1] != 0)
+      found = 0;
+
+    // a corrupted entry or a hash collision would give us a different cost
+    if (found && route_cost(route, costs, 0) != hit->cost)
+      found = 0;
+
+    if (found)
+      hit->stamp = ++cache->header->clock;
+    else
+      da_deinit(int)(route, NULL);
+  }
+
+  cache_unlock(cache);
+  return found;
+}
+
+// store route as the solution of key, replacing the least recently used entry
+// of its set if it is full
+static void cache_store(SolutionCache_t *cache, CacheKey_t *key,
+                        DistanceMatrix_t *costs, DynamicArray_t(int) * route) {
+  // canonical index of every original city
+  int canonical[MAX_CITIES];
+  for (int i = 0; i < key->city_cnt; i++)
+    canonical[key->order[i]] = i;
+
+  cache_lock(cache);
+  CacheEntry_t *set = cache_set(cache, key);
+  CacheEntry_t *victim = &set[0];
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    CacheEntry_t *entry = &set[way];
+    // the same map solved twice, or a free slot
+    if ((entry->key[0] == key->hash[0] && entry->key[1] == key->hash[1]) ||
+        entry->stamp == 0) {
+      victim = entry;
+      break;
+    }
+
+    if (entry->stamp < victim->stamp)
+      victim = entry;
+  }
+
+  memset(victim, 0, sizeof(CacheEntry_t));
+  victim->key[0] = key->hash[0];
+  victim->key[1] = key->hash[1];
+  victim->city_cnt = (uint8_t)key->city_cnt;
+  victim->sparse = (uint8_t)key->sparse;
+  victim->cost = route_cost(route, costs, 0);
+  for (size_t i = 0; i < route->len; i++)
+    victim->tour[i] = (uint8_t)canonical[route->buf[i]];
+  victim->stamp = ++cache->header->clock;
+
+  cache_unlock(cache);
+}
+
+// how maps should be solved
+typedef struct {
+  // treat missing lines as missing roads instead of roads of length 0
+  int sparse;
+  // use held_karp_mitm instead of the full Held-Karp memo
+  int mitm;
+  // if not NULL, held_karp_tsp records what it does in here. Only the regular
+  // solver is instrumented
+  SolveStats_t *stats;
+  // if not NULL, solutions are looked up here first and stored here after
+  SolutionCache_t *cache;
+} SolveOptions_t;
+
+// everything a solve needs that is worth keeping around between solves
+typedef struct {
+  Memo_t memo;
+  // the subsets of the cities of the current map, see workspace_combs. The
+  // arrays point into all_combs
+  CombinationBuffer_t combs;
+  DynamicArray_t(int64_t) comb_rows[MAX_CITIES + 1];
+  // the subsets of combs_n cities, the most any map needed so far, or nothing
+  // if combs_n is 0
+  CombinationBuffer_t all_combs;
+  int combs_n;
+  // only used by sparse solves, see held_karp_sparse
+  uint64_t *reach;
+  size_t reach_cap;
+} Workspace_t;
+
+static void workspace_init(Workspace_t *ws) {
+  memo_init(&ws->memo);
+  ws->combs = (CombinationBuffer_t){0};
+  ws->combs_n = 0;
+  ws->reach = NULL;
+  ws->reach_cap = 0;
+}
+
+static void workspace_deinit(Workspace_t *ws) {
+  free(ws->reach);
+  ws->reach = NULL;
+  ws->reach_cap = 0;
+  free_memo(&ws->memo);
+  if (ws->combs_n > 0)
+    da_deinit(DynamicArray_t(int64_t))(&ws->all_combs, int64_arr_destroy);
+  ws->combs = (CombinationBuffer_t){0};
+  ws->combs_n = 0;
+}
+
+// point ws->combs at the subsets of city_cnt cities. They are only generated
+// if no map before needed as many cities, since every size's subsets are
+// sorted: the first city_cnt choose size of them are the ones that only use
+// the first city_cnt cities
+static int workspace_combs(Workspace_t *ws, int city_cnt) {
+  if (ws->combs_n < city_cnt) {
+    if (ws->combs_n > 0)
+      da_deinit(DynamicArray_t(int64_t))(&ws->all_combs, int64_arr_destroy);
+
+    ws->combs_n = 0;
+    if (!generate_combination_matrix(&ws->all_combs, city_cnt))
+      return 0;
+
+    ws->combs_n = city_cnt;
+  }
+
+  size_t nchoosek = 1;
+  for (int k = 0; k <= city_cnt; k++) {
+    ws->comb_rows[k] = ws->all_combs.buf[k];
+    ws->comb_rows[k].len = nchoosek;
+    nchoosek = nchoosek * (size_t)(city_cnt - k) / (size_t)(k + 1);
+  }
+
+  ws->combs = (CombinationBuffer_t){.buf = ws->comb_rows,
+                                    .cap = (size_t)city_cnt + 1,
+                                    .len = (size_t)city_cnt + 1};
+  return 1;
+}
+
+// solve map using the buffers of ws and store the optimal route into route
+// The route array must be given uninitialized and must be deinited upon
+// success by the caller
+static int solve_uncached(Map_t *map, Workspace_t *ws,
+                          const SolveOptions_t *opts,
+                          DynamicArray_t(int) * route) {
+  // meeting in the middle doesn't need any of the workspace
+  if (opts->mitm)
+    return held_karp_mitm(&map->costs, NULL, route);
+
+  int city_cnt = (int)map->cities.len;
+  if (!memo_reserve(&ws->memo, city_cnt))
+    return 0;
+
+  if (!workspace_combs(ws, city_cnt))
+    return 0;
+
+  if (opts->sparse) {
+    // memo_reserve already made sure this can't overflow
+    size_t subsets = (size_t)1 << city_cnt;
+    if (subsets > ws->reach_cap) {
+      free(ws->reach);
+      ws->reach = (uint64_t *)malloc(subsets * sizeof(uint64_t));
+      ws->reach_cap = ws->reach ? subsets : 0;
+      if (!ws->reach)
+        return 0;
+    }
+
+    if (!held_karp_sparse(&map->costs, &ws->memo, &ws->combs, ws->reach))
+      return 0;
+
+    return construct_sparse_tour(&ws->memo, ws->reach, &map->costs, route);
+  }
+
+  if (opts->stats) {
+    size_t alloc_bytes = ws->memo.cap * sizeof(int64_t) +
+                         ws->all_combs.cap * sizeof(ws->all_combs.buf[0]) +
+                         map->costs.stride * (size_t)city_cnt *
+                             (map->costs.narrow ? sizeof(int16_t)
+                                                : sizeof(int32_t));
+    for (size_t i = 0; i < ws->all_combs.len; i++)
+      alloc_bytes += ws->all_combs.buf[i].cap * sizeof(int64_t);
+
+    stats_begin(opts->stats, city_cnt, alloc_bytes);
+  }
+
+  // solve the problem using the Held-Karp algorithm for TSP
+  SolveControl_t ctl = {.stats = opts->stats};
+  if (!held_karp_tsp(&map->costs, &ws->memo, &ws->combs,
+                     opts->stats ? &ctl : NULL))
+    return 0;
+
+  if (opts->stats)
+    stats_end(opts->stats);
+
+  return construct_tour(&ws->memo, &map->costs, route, 0);
+}
+
+// like solve_uncached, but goes through the cache of opts, if there is one
+static int solve_map(Map_t *map, Workspace_t *ws, const SolveOptions_t *opts,
+                     DynamicArray_t(int) * route) {
+  if (!opts->cache)
+    return solve_uncached(map, ws, opts, route);
+
+  CacheKey_t key;
+  cache_key(&map->costs, opts->sparse, &key);
+  if (cache_lookup(opts->cache, &key, &map->costs, route))
+    return 1;
+
+  if (!solve_uncached(map, ws, opts, route))
+    return 0;
+
+  cache_store(opts->cache, &key, &map->costs, route);
+  return 1;
+}
+
+// Anytime solving, see jabbamaps.h. A heuristic route is always found first,
+// so there's something to return no matter when the time budget runs out, and
+// the exact solver runs on its own thread until it either finishes or gets
+// cancelled
+
+// no path over all cities of costs is cheaper than their minimum spanning
+// tree, since the path is a spanning tree itself
+static int64_t mst_bound(DistanceMatrix_t *costs) {
+  int n = costs->city_cnt;
+  int64_t dist[MAX_CITIES];
+  uint64_t in_tree = 1;
+  for (int i = 0; i < n; i++)
+    dist[i] = dm_get(costs, 0, i);
+
+  int64_t total = 0;
+  for (int added = 1; added < n; added++) {
+    int next = -1;
+    for (int i = 0; i < n; i++)
+      if (!(in_tree & ((uint64_t)1 << i)) && (next < 0 || dist[i] < dist[next]))
+        next = i;
+
+    total += dist[next];
+    in_tree |= (uint64_t)1 << next;
+    for (int i = 0; i < n; i++)
+      if (dm_get(costs, next, i) < dist[i])
+        dist[i] = dm_get(costs, next, i);
+  }
+
+  return total;
+}
+
+// fill cheapest with the shortest road into every city
+static void cheapest_roads(DistanceMatrix_t *costs, int64_t *cheapest) {
+  for (int i = 0; i < costs->city_cnt; i++) {
+    cheapest[i] = INT64_MAX;
+    for (int j = 0; j < costs->city_cnt; j++)
+      if (i != j && dm_get(costs, j, i) < cheapest[i])
+        cheapest[i] = dm_get(costs, j, i);
+
+    if (cheapest[i] == INT64_MAX)
+      cheapest[i] = 0;
+  }
+}
+
+static int deadline_passed(const struct timespec *deadline) {
+  if (!deadline)
+    return 0;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > deadline->tv_sec ||
+         (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+// the longest run of cities or_opt moves at once
+#define OR_OPT_MAX_LEN 3
+
+// move a run of up to OR_OPT_MAX_LEN cities of path somewhere else in it,
+// possibly reversed, if that makes the path shorter. The path is open, so
+// there's no road out of the last city. Returns 1 if a run was moved
+static int or_opt(DistanceMatrix_t *costs, int *path, int n) {
+  for (int len = 1; len <= OR_OPT_MAX_LEN; len++) {
+    for (int i = 1; i + len <= n; i++) {
+      int prev = path[i - 1], first = path[i], last = path[i + len - 1];
+      int next = i + len < n ? path[i + len] : -1;
+      int64_t removed = -(int64_t)dm_get(costs, prev, first);
+      if (next >= 0)
+        removed += (int64_t)dm_get(costs, prev, next) -
+                   dm_get(costs, last, next);
+
+      for (int j = 0; j < n; j++) {
+        // the run goes after path[j], which can't be in or right before it
+        if (j >= i - 1 && j < i + len)
+          continue;
+
+        int a = path[j], b = j + 1 < n ? path[j + 1] : -1;
+        int64_t kept = b >= 0 ? dm_get(costs, a, b) : 0;
+        int64_t forward = dm_get(costs, a, first) - kept;
+        int64_t backward = dm_get(costs, a, last) - kept;
+        if (b >= 0) {
+          forward += dm_get(costs, last, b);
+          backward += dm_get(costs, first, b);
+        }
+
+        int reverse = backward < forward;
+        if (removed + (reverse ? backward : forward) >= 0)
+          continue;
+
+        int run[OR_OPT_MAX_LEN], moved[MAX_CITIES];
+        for (int k = 0; k < len; k++)
+          run[k] = path[reverse ? i + len - 1 - k : i + k];
+
+        int cnt = 0;
+        for (int k = 0; k < n; k++) {
+          if (k >= i && k < i + len)
+            continue;
+
+          moved[cnt++] = path[k];
+          if (k == j)
+            for (int r = 0; r < len; r++)
+              moved[cnt++] = run[r];
+        }
+
+        memcpy(path, moved, (size_t)n * sizeof(int));
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// build a path from city 0 by always going to the closest city that hasn't
+// been visited, then apply 2-opt and or-opt moves until there are no improving
+// ones left or deadline passes. deadline may be NULL
+static void heuristic_path(DistanceMatrix_t *costs, int *path,
+                           const struct timespec *deadline) {
+  int n = costs->city_cnt;
+  uint64_t visited = 1;
+  path[0] = 0;
+  for (int i = 1; i < n; i++) {
+    int next = -1;
+    for (int j = 0; j < n; j++)
+      if (!(visited & ((uint64_t)1 << j)) &&
+          (next < 0 || dm_get(costs, path[i - 1], j) <
+                           dm_get(costs, path[i - 1], next)))
+        next = j;
+
+    path[i] = next;
+    visited |= (uint64_t)1 << next;
+  }
+
+  // reversing path[i..j] replaces the roads into path[i] and out of path[j].
+  // The path is open, so there's no road out of the last city
+  int improved = 1;
+  while (improved && !deadline_passed(deadline)) {
+    improved = 0;
+    for (int i = 1; i < n - 1; i++) {
+      for (int j = i + 1; j < n; j++) {
+        int64_t delta = (int64_t)dm_get(costs, path[i - 1], path[j]) -
+                        dm_get(costs, path[i - 1], path[i]);
+        if (j + 1 < n)
+          delta += (int64_t)dm_get(costs, path[i], path[j + 1]) -
+                   dm_get(costs, path[j], path[j + 1]);
+
+        if (delta >= 0)
+          continue;
+
+        for (int l = i, r = j; l < r; l++, r--) {
+          int tmp = path[l];
+          path[l] = path[r];
+          path[r] = tmp;
+        }
+        improved = 1;
+      }
+    }
+
+    while (or_opt(costs, path, n) && !deadline_passed(deadline))
+      improved = 1;
   }
+}
 
-  // we will always have less than or equal to 64 cities so we are safe to do
-  // this
-  Str_t cities_buf[64];
-  DistanceMatrix_t costs = NULL;
-  DynamicArray_t(Str_t) cities = {.buf = cities_buf, .cap = 64, .len = 0};
-  if (!parse_input(file_data, &cities, &costs)) {
-    // cleanup
-    free((char *)file_data.s);
+// the memory held_karp_tsp needs for n cities: the memo and the subset lists
+static double held_karp_memory(int n) {
+  double subsets = 1;
+  for (int i = 0; i < n; i++)
+    subsets *= 2;
+
+  return subsets * (double)(n + 1) * sizeof(int64_t);
+}
+
+// roughly the most memory held_karp_mitm has allocated at once for n cities:
+// the parents of every layer of both halves and the distances of the last two
+// layers
+static double mitm_memory(int n) {
+  pthread_once(&binom_once, init_binom);
+  int m = n - 1;
+  int halves[2] = {m / 2, m - m / 2};
+
+  double total = sizeof(Mitm_t);
+  for (int h = 0; h < 2; h++) {
+    int last = halves[h];
+    for (int s = 1; s <= last; s++)
+      total += (double)binom[m][s] * s;
+
+    total += (double)binom[m][last] * last * sizeof(int64_t);
+    if (last > 1)
+      total += (double)binom[m][last - 1] * (last - 1) * sizeof(int64_t);
+  }
+
+  return total;
+}
+
+// an exact solve running in the background
+typedef struct {
+  DistanceMatrix_t *costs;
+  JmMethod_t method;
+  // if held_karp_tsp can't get its memory, try held_karp_mitm instead
+  int mitm_fallback;
+  // set by jm_solve to stop the solve
+  int cancel;
+  SolveControl_t ctl;
+  Workspace_t ws;
+  // only valid if ok is set
+  DynamicArray_t(int) route;
+  int ok;
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} ExactJob_t;
+
+static int exact_held_karp(ExactJob_t *job) {
+  Workspace_t *ws = &job->ws;
+  int city_cnt = job->costs->city_cnt;
+  if (!memo_reserve(&ws->memo, city_cnt))
+    return 0;
+
+  if (!workspace_combs(ws, city_cnt))
+    return 0;
+
+  if (!held_karp_tsp(job->costs, &ws->memo, &ws->combs, &job->ctl))
+    return 0;
+
+  return construct_tour(&ws->memo, job->costs, &job->route, 0);
+}
+
+static void *exact_job(void *arg) {
+  ExactJob_t *job = (ExactJob_t *)arg;
+
+  int ok;
+  if (job->method == JM_HELD_KARP) {
+    ok = exact_held_karp(job);
+    // whatever the memo used is better off being returned before meeting in
+    // the middle allocates its own tables
+    workspace_deinit(&job->ws);
+    if (!ok && job->mitm_fallback &&
+        !__atomic_load_n(&job->cancel, __ATOMIC_RELAXED)) {
+      job->method = JM_MEET_IN_THE_MIDDLE;
+      ok = held_karp_mitm(job->costs, &job->cancel, &job->route);
+    }
+  } else {
+    ok = held_karp_mitm(job->costs, &job->cancel, &job->route);
+  }
+
+  pthread_mutex_lock(&job->lock);
+  job->ok = ok;
+  job->done = 1;
+  pthread_cond_signal(&job->cond);
+  pthread_mutex_unlock(&job->lock);
+
+  return NULL;
+}
+
+// wait until job is done or deadline passes. deadline may be NULL
+static void exact_job_wait(ExactJob_t *job, const struct timespec *deadline) {
+  pthread_mutex_lock(&job->lock);
+  while (!job->done) {
+    if (!deadline)
+      pthread_cond_wait(&job->cond, &job->lock);
+    else if (pthread_cond_timedwait(&job->cond, &job->lock, deadline) != 0)
+      break;
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+// run the exact solver of job until it's done or deadline passes, on a thread
+// of its own. Returns 1 if the job found the optimal route
+static int exact_job_run(ExactJob_t *job, const struct timespec *deadline) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&job->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&job->lock, NULL);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, exact_job, job) == 0) {
+    exact_job_wait(job, deadline);
+    __atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+  } else {
+    // without a thread, there's nobody to watch the clock
+    exact_job(job);
+  }
+
+  pthread_cond_destroy(&job->cond);
+  pthread_mutex_destroy(&job->lock);
+  return job->ok;
+}
+
+int jm_solve(const int32_t *dists, int city_cnt, const JmBudget_t *budget,
+             JmResult_t *result) {
+  if (!dists || city_cnt < 1 || city_cnt > MAX_CITIES)
+    return 0;
+
+  struct timespec deadline_buf, *deadline = NULL;
+  if (budget && budget->time_budget > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline_buf);
+    double secs = budget->time_budget;
+    deadline_buf.tv_sec += (time_t)secs;
+    deadline_buf.tv_nsec += (long)((secs - (double)(time_t)secs) * 1e9);
+    if (deadline_buf.tv_nsec >= 1000000000L) {
+      deadline_buf.tv_sec++;
+      deadline_buf.tv_nsec -= 1000000000L;
+    }
+    deadline = &deadline_buf;
+  }
+
+  size_t n = (size_t)city_cnt;
+  int narrow = 1;
+  for (size_t i = 0; i < n * n; i++)
+    if (dists[i] < INT16_MIN || dists[i] > INT16_MAX)
+      narrow = 0;
+
+  DistanceMatrix_t costs;
+  if (!dm_init(&costs, city_cnt, narrow))
+    return 0;
+
+  for (int i = 0; i < city_cnt; i++)
+    for (int j = 0; j < city_cnt; j++)
+      dm_set(&costs, i, j, dists[(size_t)i * n + (size_t)j]);
+
+  memset(result, 0, sizeof(JmResult_t));
+  result->city_cnt = city_cnt;
+  result->method = JM_HEURISTIC;
+  result->lower_bound = mst_bound(&costs);
+  heuristic_path(&costs, result->route, deadline);
+  for (int i = 1; i < city_cnt; i++)
+    result->cost += dm_get(&costs, result->route[i - 1], result->route[i]);
+
+  double memory = budget ? (double)budget->memory_budget : 0;
+  if (memory == 0)
+    memory = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGESIZE);
+
+  // Held-Karp is preferred, since it proves a better bound after every layer
+  // and its tables fit in cache for longer
+  int fits_mitm = mitm_memory(city_cnt) <= memory;
+  ExactJob_t job = {.costs = &costs, .mitm_fallback = fits_mitm};
+  if (held_karp_memory(city_cnt) <= memory)
+    job.method = JM_HELD_KARP;
+  else if (fits_mitm)
+    job.method = JM_MEET_IN_THE_MIDDLE;
+  else
+    job.method = JM_HEURISTIC;
+
+  if (result->cost == result->lower_bound || deadline_passed(deadline))
+    job.method = JM_HEURISTIC;
+
+  if (job.method != JM_HEURISTIC) {
+    workspace_init(&job.ws);
+    job.ctl = (SolveControl_t){.cancel = &job.cancel,
+                               .track_bound = 1,
+                               .bound = result->lower_bound};
+    cheapest_roads(&costs, job.ctl.cheapest);
+
+    if (exact_job_run(&job, deadline)) {
+      // routes are stored back to front
+      for (int i = 0; i < city_cnt; i++)
+        result->route[i] = job.route.buf[city_cnt - 1 - i];
+      result->cost = route_cost(&job.route, &costs, 0);
+      result->lower_bound = result->cost;
+      result->method = job.method;
+      da_deinit(int)(&job.route, NULL);
+    } else if (job.ctl.bound > result->lower_bound) {
+      result->lower_bound = job.ctl.bound;
+    }
+
+    workspace_deinit(&job.ws);
+  }
+
+  // the bound can't ever get past the optimum, so this proves optimality
+  if (result->lower_bound >= result->cost) {
+    result->lower_bound = result->cost;
+    result->optimal = 1;
+  }
+
+  dm_deinit(&costs);
+  return 1;
+}
+
+typedef char *Path_t;
+DA_DECLARE_IMPL(Path_t)
+
+static void path_destroy(Path_t path) { free(path); }
+
+// append every regular file inside of dirname to paths
+static int list_directory(const char *dirname, DynamicArray_t(Path_t) * paths) {
+  DIR *dir = opendir(dirname);
+  if (!dir) {
+    perror("could not open batch directory");
+    return 0;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    // skip hidden files as well as . and ..
+    if (entry->d_name[0] == '.')
+      continue;
+
+    Path_t path = (Path_t)malloc(strlen(dirname) + strlen(entry->d_name) + 2);
+    if (!path) {
+      closedir(dir);
+      return 0;
+    }
+
+    sprintf(path, "%s/%s", dirname, entry->d_name);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      free(path);
+      continue;
+    }
+
+    if (!da_push(Path_t)(paths, path)) {
+      free(path);
+      closedir(dir);
+      return 0;
+    }
+  }
+
+  closedir(dir);
+  return 1;
+}
+
+// append every non-empty line of the manifest called filename to paths
+static int read_manifest(const char *filename, DynamicArray_t(Path_t) * paths) {
+  Str_t data;
+  if (!mmap_file(filename, &data))
+    return 0;
+
+  Str_t rest = data;
+  while (rest.len != 0) {
+    Str_t line = ss_trim(ss_split_once(&rest, '\n'));
+    if (line.len == 0)
+      continue;
+
+    Path_t path = strndup(line.s, line.len);
+    if (!path || !da_push(Path_t)(paths, path)) {
+      free(path);
+      munmap_file(data);
+      return 0;
+    }
+  }
+
+  munmap_file(data);
+  return 1;
+}
+
+// the shared state of all batch workers
+typedef struct {
+  DynamicArray_t(Path_t) * maps;
+  // index of the next map to solve
+  size_t next;
+  size_t failed;
+  FILE *out;
+  const SolveOptions_t *opts;
+  // how many threads every worker faults in its memo with, so the workers
+  // don't spawn a thread per cpu each
+  size_t touch_threads;
+  pthread_mutex_t lock;
+} Batch_t;
+
+// thread entry point, arg is a Batch_t
+static void *batch_worker(void *arg) {
+  Batch_t *batch = (Batch_t *)arg;
+  // every worker keeps its memo around, so it is only reallocated when a map
+  // with more cities than any map before it shows up
+  Workspace_t ws;
+  workspace_init(&ws);
+  ws.memo.touch_threads = batch->touch_threads;
+
+  while (1) {
+    pthread_mutex_lock(&batch->lock);
+    size_t idx = batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (idx >= batch->maps->len)
+      break;
+
+    const char *path = batch->maps->buf[idx];
+    Map_t map;
+    DynamicArray_t(int) route;
+    int loaded = map_load(path, &map);
+    int solved = loaded && solve_map(&map, &ws, batch->opts, &route);
+
+    // results are written as soon as they are ready, so the output file is in
+    // completion order. Every result starts with the path of its map
+    pthread_mutex_lock(&batch->lock);
+    fprintf(batch->out, "== %s\n", path);
+    if (solved) {
+      print_results(batch->out, &route, &map.cities, &map.costs);
+    } else {
+      fprintf(batch->out, "could not solve map\n");
+      batch->failed++;
+    }
+    fflush(batch->out);
+    pthread_mutex_unlock(&batch->lock);
+
+    if (solved)
+      da_deinit(int)(&route, NULL);
+
+    if (loaded)
+      map_deinit(&map);
+  }
+
+  workspace_deinit(&ws);
+  return NULL;
+}
+
+// solve every map listed by source(either a directory or a manifest file with
+// one path per line) on a pool of threads, writing all results into the file
+// called output
+static int solve_batch(const char *source, const char *output,
+                       const SolveOptions_t *opts) {
+  DynamicArray_t(Path_t) maps;
+  if (!da_init(Path_t)(&maps, 16))
+    return 1;
+
+  struct stat st;
+  if (stat(source, &st) != 0) {
+    perror("could not find batch source");
+    da_deinit(Path_t)(&maps, NULL);
     return 1;
   }
 
-  if (cities.len == 0) {
-    fprintf(stderr, "input file does not contain any cities\n");
+  int listed = S_ISDIR(st.st_mode) ? list_directory(source, &maps)
+                                   : read_manifest(source, &maps);
+  if (!listed) {
+    da_deinit(Path_t)(&maps, path_destroy);
     return 1;
   }
 
-  Memo_t memo;
-  if (!create_memo(&cities, &memo)) {
-    // cleanup
-    free_heap_table(cities.len, (void **)costs);
-    free((char *)file_data.s);
+  Batch_t batch = {.maps = &maps, .next = 0, .failed = 0, .opts = opts};
+  batch.out = fopen(output, "w");
+  if (!batch.out) {
+    perror("could not open batch output file");
+    da_deinit(Path_t)(&maps, path_destroy);
     return 1;
   }
 
-  // solve the problem using the Held-Karp algorithm for TSP
-  if (!held_karp_tsp(costs, &memo)) {
-    // cleanup
-    free_heap_table(cities.len, (void **)costs);
-    free((char *)file_data.s);
-    free_memo(&memo);
+  if (pthread_mutex_init(&batch.lock, NULL) != 0) {
+    fclose(batch.out);
+    da_deinit(Path_t)(&maps, path_destroy);
+    return 1;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t cpu_cnt = cpus > 0 ? (size_t)cpus : 1;
+  size_t worker_cnt = cpu_cnt;
+  if (worker_cnt > maps.len)
+    worker_cnt = maps.len;
+
+  // the workers split the cpus between them
+  batch.touch_threads = worker_cnt > 0 ? cpu_cnt / worker_cnt : 1;
+
+  pthread_t *workers = (pthread_t *)calloc(worker_cnt, sizeof(pthread_t));
+  size_t spawned = 0;
+  while (workers && spawned < worker_cnt &&
+         pthread_create(&workers[spawned], NULL, batch_worker, &batch) == 0)
+    spawned++;
+
+  // if we couldn't get any threads, we do all the work ourselves
+  if (spawned == 0)
+    batch_worker(&batch);
+
+  for (size_t i = 0; i < spawned; i++)
+    pthread_join(workers[i], NULL);
+
+  free(workers);
+  pthread_mutex_destroy(&batch.lock);
+
+  int res = batch.failed == 0 ? 0 : 1;
+  if (batch.failed > 0)
+    fprintf(stderr, "could not solve %zu out of %zu maps\n", batch.failed,
+            maps.len);
+
+  if (fclose(batch.out) != 0) {
+    perror("could not close batch output file");
+    res = 1;
+  }
+
+  da_deinit(Path_t)(&maps, path_destroy);
+  return res;
+}
+
+// solve map for a closed tour as well as for open paths from every start city
+// and print the results as a table
+static int solve_all_starts(const char *filename) {
+  Map_t map;
+  if (!map_load(filename, &map))
+    return 1;
+
+  DynamicArray_t(int) route;
+  Workspace_t ws;
+  workspace_init(&ws);
+
+  // the regular solve leaves the paths starting at city 0 in the memo, which is
+  // also all we need to close the tour
+  SolveOptions_t opts = {0};
+  if (!solve_map(&map, &ws, &opts, &route)) {
+    workspace_deinit(&ws);
+    map_deinit(&map);
+    return 1;
+  }
+
+  da_deinit(int)(&route, NULL);
+  if (!construct_tour(&ws.memo, &map.costs, &route, 1)) {
+    workspace_deinit(&ws);
+    map_deinit(&map);
+    return 1;
+  }
+
+  // a closed tour costs the same regardless of where we start, so all starting
+  // cities share the same tour, just rotated
+  printf("Optimal closed tour(the same for every start city):\n");
+  for (int i = (int)route.len - 1; i >= 0; i--) {
+    ss_print(stdout, map.cities.buf[route.buf[i]]);
+    printf(" -> ");
+  }
+  ss_print(stdout, map.cities.buf[route.buf[route.len - 1]]);
+  printf("\nTotal cost: %" PRId64 "\n\n", route_cost(&route, &map.costs, 1));
+  da_deinit(int)(&route, NULL);
+
+  // now redo the memo for paths that can start anywhere
+  if (!held_karp_open(&map.costs, &ws.memo, &ws.combs)) {
+    workspace_deinit(&ws);
+    map_deinit(&map);
     return 1;
   }
 
+  int name_width = (int)strlen("Start city");
+  for (size_t i = 0; i < map.cities.len; i++)
+    if ((int)map.cities.buf[i].len > name_width)
+      name_width = (int)map.cities.buf[i].len;
+
+  printf("Best path for every start city:\n");
+  printf("%-*s  %12s  %s\n", name_width, "Start city", "Cost", "Path");
+  int res = 0;
+  for (int start = 0; start < (int)map.cities.len; start++) {
+    if (!construct_open_path(&ws.memo, &map.costs, start, &route)) {
+      res = 1;
+      break;
+    }
+
+    Str_t name = map.cities.buf[start];
+    printf("%-*.*s  %12" PRId64 "  ", name_width, (int)name.len, name.s,
+           route_cost(&route, &map.costs, 0));
+    for (int i = (int)route.len - 1; i >= 0; i--) {
+      ss_print(stdout, map.cities.buf[route.buf[i]]);
+      if (i != 0)
+        printf(" -> ");
+    }
+    printf("\n");
+
+    da_deinit(int)(&route, NULL);
+  }
+
+  workspace_deinit(&ws);
+  map_deinit(&map);
+  return res;
+}
+
+// the most roads a map can have, and thus the most that can change in a session
+#define MAX_ROADS (MAX_CITIES * (MAX_CITIES - 1) / 2)
+
+// the index of the city called name, or -1 if there's none
+static int find_city(DynamicArray_t(Str_t) * cities, Str_t name) {
+  for (size_t i = 0; i < cities->len; i++)
+    if (ss_eq(cities->buf[i], name))
+      return (int)i;
+
+  return -1;
+}
+
+// set the distance between from and to, switching costs over to a matrix we
+// own, and to wider entries, if needed
+static int dm_update(DistanceMatrix_t *costs, int from, int to, int32_t dist) {
+  int fits = dist >= INT16_MIN && dist <= INT16_MAX;
+  if (costs->borrowed || (costs->narrow && !fits)) {
+    DistanceMatrix_t copy;
+    if (!dm_init(&copy, costs->city_cnt, costs->narrow && fits))
+      return 0;
+
+    for (int i = 0; i < costs->city_cnt; i++)
+      for (int j = 0; j < costs->city_cnt; j++)
+        dm_set(&copy, i, j, dm_get(costs, i, j));
+    memcpy(copy.adj, costs->adj, sizeof(copy.adj));
+
+    dm_deinit(costs);
+    *costs = copy;
+  }
+
+  dm_set(costs, from, to, dist);
+  dm_set(costs, to, from, dist);
+  costs->adj[from] |= (uint64_t)1 << to;
+  costs->adj[to] |= (uint64_t)1 << from;
+  return 1;
+}
+
+// whether route goes straight from a to b or from b to a
+static int route_uses(DynamicArray_t(int) * route, int a, int b) {
+  for (size_t i = 1; i < route->len; i++)
+    if ((route->buf[i] == a && route->buf[i - 1] == b) ||
+        (route->buf[i] == b && route->buf[i - 1] == a))
+      return 1;
+
+  return 0;
+}
+
+// solve the map in filename, then keep reading lines of the same form as the
+// input file from stdin, each one changing the distance between two cities,
+// and print the optimal route after every change.
+// Changes that can't make the current route worse than any other, an increase
+// on a road it doesn't use or a decrease on one it does, are answered right
+// away. For everything else, the memo is only repaired where it needs to be,
+// see held_karp_repair. Since the quick answers leave the memo out of date,
+// their roads are remembered and repaired along with the next one that needs
+// a repair
+static int run_session(const char *filename) {
+  Map_t map;
+  if (!map_load(filename, &map))
+    return 1;
+
+  Workspace_t ws;
+  workspace_init(&ws);
+  SolveOptions_t opts = {0};
+  DynamicArray_t(int) route;
+  if (!solve_map(&map, &ws, &opts, &route)) {
+    workspace_deinit(&ws);
+    map_deinit(&map);
+    return 1;
+  }
+
+  print_results(stdout, &route, &map.cities, &map.costs);
+  fflush(stdout);
+
+  // a mask with both cities of every road changed since the last repair
+  static uint64_t stale[MAX_ROADS];
+  int stale_cnt = 0;
+
+  int res = 0;
+  char *line_buf = NULL;
+  size_t line_cap = 0;
+  ssize_t line_len;
+  while ((line_len = getline(&line_buf, &line_cap, stdin)) >= 0) {
+    Str_t line = ss_trim((Str_t){.s = line_buf, .len = (size_t)line_len});
+    if (line.len == 0)
+      continue;
+
+    int from = find_city(&map.cities, ss_trim(ss_split_once(&line, '-')));
+    int to = find_city(&map.cities, ss_trim(ss_split_once(&line, ':')));
+    int32_t dist;
+    if (from < 0 || to < 0 || from == to) {
+      fprintf(stderr, "a change needs two different cities of the map\n");
+      continue;
+    }
+
+    if (!parse_cost(ss_trim(line), &dist))
+      continue;
+
+    int32_t old = dm_get(&map.costs, from, to);
+    int on_route = route_uses(&route, from, to);
+    if (!dm_update(&map.costs, from, to, dist)) {
+      res = 1;
+      break;
+    }
+
+    uint64_t road = ((uint64_t)1 << from) | ((uint64_t)1 << to);
+    int known = 0;
+    for (int i = 0; i < stale_cnt && !known; i++)
+      known = stale[i] == road;
+    if (!known)
+      stale[stale_cnt++] = road;
+
+    int still_optimal = on_route ? dist <= old : dist >= old;
+    if (!still_optimal) {
+      held_karp_repair(&map.costs, &ws.memo, &ws.combs, stale, stale_cnt);
+      stale_cnt = 0;
+
+      da_deinit(int)(&route, NULL);
+      if (!construct_tour(&ws.memo, &map.costs, &route, 0)) {
+        // there is no route to deinit anymore
+        workspace_deinit(&ws);
+        map_deinit(&map);
+        free(line_buf);
+        return 1;
+      }
+    }
+
+    printf("\n");
+    print_results(stdout, &route, &map.cities, &map.costs);
+    fflush(stdout);
+  }
+
+  free(line_buf);
+  da_deinit(int)(&route, NULL);
+  workspace_deinit(&ws);
+  map_deinit(&map);
+  return res;
+}
+
+// load the map in input and write it into output as a compiled map
+static int compile_map(const char *input, const char *output) {
+  Map_t map;
+  if (!map_load(input, &map))
+    return 1;
+
+  FILE *out = fopen(output, "wb");
+  if (!out) {
+    perror("could not open output file");
+    map_deinit(&map);
+    return 1;
+  }
+
+  int ok = write_compiled_map(&map.cities, &map.costs, out);
+  if (fclose(out) != 0) {
+    perror("could not write compiled map");
+    ok = 0;
+  }
+
+  map_deinit(&map);
+  return !ok;
+}
+
+// solve the map in filename and print the results. If stats is not NULL, the
+// solve is instrumented and, if stats_file is given, the stats get written to it
+static int solve_single(const char *filename, SolveOptions_t *opts,
+                        SolveStats_t *stats, const char *stats_file) {
+  opts->stats = stats;
+
+  // open the stats file before solving, so we don't find out it can't be
+  // written after a long solve
+  FILE *stats_out = NULL;
+  if (stats_file && !(stats_out = fopen(stats_file, "w"))) {
+    perror("could not open stats file");
+    return 1;
+  }
+
+  Map_t map;
+  if (!map_load(filename, &map)) {
+    if (stats_out)
+      fclose(stats_out);
+    return 1;
+  }
+
+  Workspace_t ws;
+  workspace_init(&ws);
+
   DynamicArray_t(int) route;
-  if (!construct_tour(&memo, costs, &route)) {
+  if (!solve_map(&map, &ws, opts, &route)) {
     // cleanup
-    free_heap_table(cities.len, (void **)costs);
-    free_memo(&memo);
-    free((char *)file_data.s);
+    if (stats_out)
+      fclose(stats_out);
+    workspace_deinit(&ws);
+    map_deinit(&map);
     return 1;
   }
 
-  print_results(&route, &cities, costs);
+  print_results(stdout, &route, &map.cities, &map.costs);
+
+  int res = 0;
+  if (stats_out) {
+    stats_write_json(stats, stats_out);
+    if (fclose(stats_out) != 0) {
+      perror("could not write stats file");
+      res = 1;
+    }
+  }
 
   // cleanup
   da_deinit(int)(&route, NULL);
-  free_heap_table(cities.len, (void **)costs);
-  free_memo(&memo);
-  free((char *)file_data.s);
+  workspace_deinit(&ws);
+  map_deinit(&map);
+
+  return res;
+}
+
+// solve filename through jm_solve, within budget
+static int solve_budgeted(const char *filename, const JmBudget_t *budget) {
+  Map_t map;
+  if (!map_load(filename, &map))
+    return 1;
+
+  int city_cnt = (int)map.cities.len;
+  int32_t *dists = NULL;
+  if (city_cnt > 0)
+    dists = (int32_t *)malloc((size_t)city_cnt * city_cnt * sizeof(int32_t));
+  if (!dists) {
+    fprintf(stderr, "could not allocate distances\n");
+    map_deinit(&map);
+    return 1;
+  }
+
+  for (int i = 0; i < city_cnt; i++)
+    for (int j = 0; j < city_cnt; j++)
+      dists[i * city_cnt + j] = dm_get(&map.costs, i, j);
+
+  JmResult_t result;
+  DynamicArray_t(int) route;
+  int ok = jm_solve(dists, city_cnt, budget, &result) &&
+           da_init(int)(&route, city_cnt);
+  free(dists);
+  if (!ok) {
+    // jm_solve doesn't say why, but the map was already checked, so the only
+    // way it fails is running out of memory
+    fprintf(stderr, "could not allocate memory for the solve\n");
+    map_deinit(&map);
+    return 1;
+  }
+
+  // print_results expects routes back to front
+  for (int i = city_cnt - 1; i >= 0; i--)
+    da_push(int)(&route, result.route[i]);
+
+  print_results(stdout, &route, &map.cities, &map.costs);
+  if (!result.optimal)
+    printf("Lower bound: %" PRId64 " (the route is at most %.2f%% longer "
+           "than the shortest one)\n",
+           result.lower_bound,
+           result.lower_bound > 0 ? 100.0 * (double)(result.cost -
+                                                     result.lower_bound) /
+                                        (double)result.lower_bound
+                                  : 0.0);
 
+  da_deinit(int)(&route, NULL);
+  map_deinit(&map);
   return 0;
 }
+
+// parse a budget given on the command line. Returns 0 if it isn't a positive
+// number
+static int parse_budget(const char *arg, double *out) {
+  char *end;
+  *out = strtod(arg, &end);
+  return end != arg && *end == '\0' && *out > 0;
+}
+
+#ifndef JABBAMAPS_NO_MAIN
+int main(int argc, const char **argv) {
+  SolveOptions_t opts = {0};
+  SolveStats_t stats = {0};
+  int progress = 0;
+  const char *stats_file = NULL;
+  const char *cache_file = NULL;
+  JmBudget_t budget = {0};
+  int budgeted = 0;
+
+  // options come first, followed by the mode and its arguments
+  int arg = 1;
+  for (; arg < argc; arg++) {
+    if (strcmp(argv[arg], "--sparse") == 0)
+      opts.sparse = 1;
+    else if (strcmp(argv[arg], "--mitm") == 0)
+      opts.mitm = 1;
+    else if (strcmp(argv[arg], "--progress") == 0)
+      progress = 1;
+    else if (strcmp(argv[arg], "--stats") == 0 && arg + 1 < argc)
+      stats_file = argv[++arg];
+    else if (strcmp(argv[arg], "--cache") == 0 && arg + 1 < argc)
+      cache_file = argv[++arg];
+    else if (strcmp(argv[arg], "--time-budget") == 0 && arg + 1 < argc) {
+      if (!parse_budget(argv[++arg], &budget.time_budget)) {
+        fprintf(stderr, "--time-budget must be a positive amount of seconds\n");
+        return 1;
+      }
+      budgeted = 1;
+    } else if (strcmp(argv[arg], "--memory-budget") == 0 && arg + 1 < argc) {
+      double mb;
+      if (!parse_budget(argv[++arg], &mb)) {
+        fprintf(stderr, "--memory-budget must be a positive amount of MB\n");
+        return 1;
+      }
+      budget.memory_budget = (size_t)(mb * (1 << 20));
+      budgeted = 1;
+    } else
+      break;
+  }
+
+  if (opts.sparse && opts.mitm) {
+    fprintf(stderr, "--sparse can't be combined with --mitm\n");
+    return 1;
+  }
+
+  int instrumented = progress || stats_file;
+  if (instrumented && (opts.sparse || opts.mitm)) {
+    fprintf(stderr, "--progress and --stats only work with the regular "
+                    "solver\n");
+    return 1;
+  }
+
+  int rest = argc - arg;
+  int batch = rest == 3 && strcmp(argv[arg], "--batch") == 0;
+  if (batch && instrumented) {
+    fprintf(stderr, "--progress and --stats only work on a single map\n");
+    return 1;
+  }
+
+  if (budgeted && (opts.sparse || opts.mitm || instrumented || cache_file ||
+                   batch)) {
+    fprintf(stderr, "--time-budget and --memory-budget pick the solver "
+                    "themselves and only work on a single map\n");
+    return 1;
+  }
+
+  int has_options =
+      opts.sparse || opts.mitm || instrumented || cache_file || budgeted;
+  if (rest == 3 && strcmp(argv[arg], "--compile") == 0) {
+    if (has_options) {
+      fprintf(stderr, "--compile doesn't take any options\n");
+      return 1;
+    }
+
+    return compile_map(argv[arg + 1], argv[arg + 2]);
+  }
+
+  if (rest == 2 && strcmp(argv[arg], "--session") == 0) {
+    if (has_options) {
+      fprintf(stderr, "--session doesn't take any options\n");
+      return 1;
+    }
+
+    return run_session(argv[arg + 1]);
+  }
+
+  if (rest == 2 && strcmp(argv[arg], "--all-starts") == 0) {
+    if (has_options) {
+      fprintf(stderr, "--all-starts doesn't take any options\n");
+      return 1;
+    }
+
+    return solve_all_starts(argv[arg + 1]);
+  }
+
+  if (!batch && (rest != 1 || strncmp(argv[arg], "--", 2) == 0))
+    return print_usage(argv[0]);
+
+  if (budgeted)
+    return solve_budgeted(argv[arg], &budget);
+
+  SolutionCache_t cache;
+  if (cache_file) {
+    if (!cache_open(cache_file, &cache))
+      return 1;
+
+    opts.cache = &cache;
+  }
+
+  if (instrumented)
+    stats.progress = progress ? stderr : NULL;
+
+  int res = batch ? solve_batch(argv[arg + 1], argv[arg + 2], &opts)
+                  : solve_single(argv[arg], &opts,
+                                 instrumented ? &stats : NULL, stats_file);
+
+  if (cache_file)
+    cache_close(&cache);
+
+  return res;
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef JABBAMAPS_H
+#define JABBAMAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the most cities jm_solve accepts
+#define JM_MAX_CITIES 64
+
+// limits for a single solve. A limit of 0 means there is none
+typedef struct {
+  // seconds until jm_solve returns whatever it has found
+  double time_budget;
+  // bytes the exact solvers may allocate. Without a limit, this is the amount
+  // of physical memory
+  size_t memory_budget;
+} JmBudget_t;
+
+// the solver that produced a result
+typedef enum {
+  // Held-Karp over all subsets, needs n * 2^n entries
+  JM_HELD_KARP,
+  // Held-Karp meeting in the middle, only stores subsets of up to half of the
+  // cities
+  JM_MEET_IN_THE_MIDDLE,
+  // nearest neighbour improved with 2-opt. Used when the exact solvers don't
+  // fit in the memory budget or run out of time
+  JM_HEURISTIC,
+} JmMethod_t;
+
+typedef struct {
+  // the cities in the order they are visited, starting at city 0
+  int route[JM_MAX_CITIES];
+  int city_cnt;
+  // the total distance travelled along route
+  int64_t cost;
+  // no route costs less than this, so cost - lower_bound is the most the
+  // result can be off by
+  int64_t lower_bound;
+  // set if route is proven to be the shortest one
+  int optimal;
+  JmMethod_t method;
+} JmResult_t;
+
+// find the shortest path that starts at city 0 and visits all city_cnt
+// cities. dists is a row-major city_cnt x city_cnt matrix and must be
+// symmetric.
+// The exact solvers run on a background thread. If the time budget runs out
+// before they are done, they are stopped and the best route found so far is
+// returned, along with the best lower bound that was proven for it. Setting up
+// the solvers(mapping their memory) can't be interrupted, so jm_solve may
+// overrun the time budget by that much. Once they run, they stop within a few
+// thousand subsets.
+// Returns 1 on success and 0 if the input is invalid or memory ran out
+int jm_solve(const int32_t *dists, int city_cnt, const JmBudget_t *budget,
+             JmResult_t *result);
+
+#endif
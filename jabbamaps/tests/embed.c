@@ -0,0 +1,63 @@
+// a program that embeds libjabbamaps.a and uses std.h itself, the way any
+// std.h user does. It only links if the library keeps its own copies of std.h
+// and of its solvers to itself
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../std.h/include/dynamic_array.h"
+#include "../../std.h/include/hash_map.h"
+
+#define SS_IMPL
+#include "../../std.h/include/string_slice.h"
+
+#include "../src/jabbamaps.h"
+
+DA_DECLARE_IMPL(int)
+HM_DECLARE_IMPL(Str_t, int)
+
+// the same name as one of the solvers of the library
+int held_karp_tsp(void) { return 0; }
+
+static uint64_t str_hash(Str_t *s) { return s->len; }
+
+static int str_eq(Str_t *a, Str_t *b) { return ss_eq(*a, *b); }
+
+#define CITY_CNT 6
+
+int main(void) {
+  // cities on a line, so the shortest path walks along it
+  int32_t dists[CITY_CNT * CITY_CNT];
+  for (int i = 0; i < CITY_CNT; i++)
+    for (int j = 0; j < CITY_CNT; j++)
+      dists[i * CITY_CNT + j] = abs(i - j);
+
+  JmBudget_t budget = {.time_budget = 10};
+  JmResult_t result;
+  assert(jm_solve(dists, CITY_CNT, &budget, &result) && "could not solve");
+  assert(result.optimal && result.cost == CITY_CNT - 1 && "bad cost");
+  assert(result.route[0] == 0 && "route doesn't start at city 0");
+
+  // invalid input fails without printing anything
+  assert(!jm_solve(dists, 0, &budget, &result) && "solved an empty map");
+
+  // and std.h works as usual next to it
+  DynamicArray_t(int) route;
+  assert(da_init(int)(&route, CITY_CNT) && "could not allocate route");
+  HashMap_t(Str_t, int) names;
+  assert(hm_init(Str_t, int)(&names, 16, str_hash, str_eq) &&
+         "could not allocate names");
+  for (int i = 0; i < CITY_CNT; i++) {
+    assert(da_push(int)(&route, result.route[i]) && "could not push city");
+    assert(hm_put(Str_t, int)(&names, ss_from_cstring("city"), i) &&
+           "could not put city");
+  }
+  Str_t city = ss_from_cstring("city");
+  assert(*hm_get(Str_t, int)(&names, &city) == CITY_CNT - 1 &&
+         "bad city index");
+
+  hm_deinit(Str_t, int)(&names, NULL);
+  da_deinit(int)(&route, NULL);
+  return held_karp_tsp();
+}
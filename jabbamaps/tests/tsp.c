@@ -0,0 +1,601 @@
+#define JABBAMAPS_NO_MAIN
+// jabbamaps.c sets up the feature macros, so it has to come first
+#include "../src/jabbamaps.c"
+
+#include <assert.h>
+
+// fill map with city_cnt cities and random distances below max_dist
+static void random_map(Map_t *map, int city_cnt, int32_t max_dist) {
+  static const char *names = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  assert(da_init(Str_t)(&map->cities, city_cnt) && "could not allocate cities");
+  for (int i = 0; i < city_cnt; i++) {
+    Str_t name = {.s = names + i, .len = 1};
+    assert(da_push(Str_t)(&map->cities, name) && "could not push city");
+  }
+
+  int narrow = max_dist <= INT16_MAX;
+  assert(dm_init(&map->costs, city_cnt, narrow) && "could not allocate matrix");
+  for (int i = 0; i < city_cnt; i++) {
+    for (int j = i + 1; j < city_cnt; j++) {
+      int32_t dist = (int32_t)(rand() % max_dist);
+      dm_set(&map->costs, i, j, dist);
+      dm_set(&map->costs, j, i, dist);
+    }
+  }
+}
+
+static void random_map_deinit(Map_t *map) {
+  dm_deinit(&map->costs);
+  da_deinit(Str_t)(&map->cities, NULL);
+}
+
+// solve map with both engines and check they agree on the cost and that the
+// meet in the middle route visits every city once, starting at city 0
+static void check_engines(Map_t *map) {
+  int city_cnt = (int)map->cities.len;
+  Workspace_t ws;
+  workspace_init(&ws);
+
+  SolveOptions_t held_karp = {0};
+  DynamicArray_t(int) expect;
+  assert(solve_map(map, &ws, &held_karp, &expect) && "held karp failed");
+
+  SolveOptions_t mitm = {.mitm = 1};
+  DynamicArray_t(int) route;
+  assert(solve_map(map, &ws, &mitm, &route) && "mitm failed");
+
+  assert(route.len == (size_t)city_cnt && "bad route length");
+  assert(route.buf[route.len - 1] == 0 && "route doesn't start at city 0");
+  uint64_t seen = 0;
+  for (size_t i = 0; i < route.len; i++) {
+    assert(!(seen & ((uint64_t)1 << route.buf[i])) && "city visited twice");
+    seen |= (uint64_t)1 << route.buf[i];
+  }
+
+  assert(route_cost(&route, &map->costs, 0) ==
+             route_cost(&expect, &map->costs, 0) &&
+         "engines disagree");
+
+  da_deinit(int)(&route, NULL);
+  da_deinit(int)(&expect, NULL);
+  workspace_deinit(&ws);
+}
+
+void test_mitm_random() {
+  srand(42);
+  for (int city_cnt = 1; city_cnt <= 12; city_cnt++) {
+    for (int round = 0; round < 8; round++) {
+      Map_t map;
+      // every other round needs the wide matrix
+      random_map(&map, city_cnt, round % 2 ? 100 : 100000);
+      check_engines(&map);
+      random_map_deinit(&map);
+    }
+  }
+}
+
+void test_mitm_files() {
+  const char *files[] = {"map7.txt", "test_file.txt"};
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    Map_t map;
+    assert(map_load(files[i], &map) && "could not load map");
+    check_engines(&map);
+    map_deinit(&map);
+  }
+}
+
+void test_cache_relabel() {
+  const char *path = "tsp-test.cache";
+  unlink(path);
+  SolutionCache_t cache;
+  assert(cache_open(path, &cache) && "could not open cache");
+
+  srand(36);
+  Map_t map;
+  random_map(&map, 10, 1000);
+  Workspace_t ws;
+  workspace_init(&ws);
+  SolveOptions_t opts = {.cache = &cache};
+  DynamicArray_t(int) route;
+  assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+  int64_t cost = route_cost(&route, &map.costs, 0);
+  da_deinit(int)(&route, NULL);
+
+  // the same map with every city but the first one moved around
+  int perm[10];
+  for (int i = 0; i < 10; i++)
+    perm[i] = i;
+  for (int i = 9; i > 1; i--) {
+    int j = 1 + rand() % i;
+    int tmp = perm[i];
+    perm[i] = perm[j];
+    perm[j] = tmp;
+  }
+
+  Map_t relabeled;
+  random_map(&relabeled, 10, 1000);
+  for (int i = 0; i < 10; i++)
+    for (int j = 0; j < 10; j++)
+      dm_set(&relabeled.costs, perm[i], perm[j], dm_get(&map.costs, i, j));
+
+  CacheKey_t key;
+  cache_key(&relabeled.costs, 0, &key);
+  assert(cache_lookup(&cache, &key, &relabeled.costs, &route) && "cache miss");
+  assert(route.len == 10 && route.buf[9] == 0 && "bad cached route");
+  assert(route_cost(&route, &relabeled.costs, 0) == cost && "bad cached cost");
+  da_deinit(int)(&route, NULL);
+
+  // sparse solves of the same map are a different problem
+  cache_key(&relabeled.costs, 1, &key);
+  assert(!cache_lookup(&cache, &key, &relabeled.costs, &route) &&
+         "sparse hit on a dense solution");
+
+  // an entry that visits a city twice is rejected, even if its cost matches
+  cache_key(&relabeled.costs, 0, &key);
+  CacheEntry_t *entry = cache_set(&cache, &key);
+  while (entry->key[0] != key.hash[0] || entry->key[1] != key.hash[1])
+    entry++;
+  entry->tour[1] = entry->tour[2];
+  assert(da_init(int)(&route, 10) && "could not allocate route");
+  for (int i = 0; i < 10; i++)
+    da_push(int)(&route, key.order[entry->tour[i]]);
+  entry->cost = route_cost(&route, &relabeled.costs, 0);
+  da_deinit(int)(&route, NULL);
+  assert(!cache_lookup(&cache, &key, &relabeled.costs, &route) &&
+         "hit on a route that isn't a permutation");
+
+  random_map_deinit(&relabeled);
+  random_map_deinit(&map);
+  workspace_deinit(&ws);
+  cache_close(&cache);
+  unlink(path);
+}
+
+// write len bytes of data to path
+static void write_file(const char *path, const char *data, size_t len) {
+  FILE *out = fopen(path, "wb");
+  assert(out && "could not open file");
+  assert(fwrite(data, 1, len, out) == len && "could not write file");
+  assert(fclose(out) == 0 && "could not write file");
+}
+
+void test_compiled_maps() {
+  const char *path = "tsp-test.jbm";
+  srand(37);
+  for (int round = 0; round < 4; round++) {
+    // both narrow and wide matrices
+    Map_t map;
+    random_map(&map, 5 + round * 3, round % 2 ? 100 : 100000);
+    FILE *out = fopen(path, "wb");
+    assert(out && "could not open compiled map");
+    assert(write_compiled_map(&map.cities, &map.costs, out) &&
+           "could not compile map");
+    assert(fclose(out) == 0 && "could not write compiled map");
+
+    Map_t compiled;
+    assert(map_load(path, &compiled) && "could not load compiled map");
+    assert(compiled.costs.borrowed && "compiled matrix was copied");
+    assert(compiled.cities.len == map.cities.len && "bad city count");
+    for (size_t i = 0; i < map.cities.len; i++)
+      assert(ss_eq(compiled.cities.buf[i], map.cities.buf[i]) &&
+             "bad city name");
+
+    Workspace_t ws;
+    workspace_init(&ws);
+    SolveOptions_t opts = {0};
+    DynamicArray_t(int) expect, route;
+    assert(solve_map(&map, &ws, &opts, &expect) && "could not solve");
+    assert(solve_map(&compiled, &ws, &opts, &route) &&
+           "could not solve compiled map");
+    assert(route.len == expect.len && "bad route length");
+    for (size_t i = 0; i < route.len; i++)
+      assert(route.buf[i] == expect.buf[i] && "compiled map solved differently");
+    assert(route_cost(&route, &compiled.costs, 0) ==
+               route_cost(&expect, &map.costs, 0) &&
+           "bad compiled cost");
+    da_deinit(int)(&route, NULL);
+    da_deinit(int)(&expect, NULL);
+    workspace_deinit(&ws);
+
+    // keep a copy of the file to damage
+    size_t len = compiled.data.len;
+    char *bytes = (char *)malloc(len);
+    assert(bytes && "could not allocate");
+    memcpy(bytes, compiled.data.s, len);
+    map_deinit(&compiled);
+
+    write_file(path, bytes, len - 1);
+    assert(!map_load(path, &compiled) && "loaded a truncated map");
+    write_file(path, bytes, sizeof(CompiledHeader_t));
+    assert(!map_load(path, &compiled) && "loaded a map without a matrix");
+
+    bytes[0] = 'X';
+    write_file(path, bytes, len);
+    assert(!map_load(path, &compiled) && "loaded a map with a bad magic");
+
+    free(bytes);
+    random_map_deinit(&map);
+  }
+
+  unlink(path);
+}
+
+void test_repair() {
+  srand(38);
+  for (int round = 0; round < 20; round++) {
+    int city_cnt = 3 + round % 9;
+    Map_t map;
+    random_map(&map, city_cnt, 1000);
+    Workspace_t ws;
+    workspace_init(&ws);
+    SolveOptions_t opts = {0};
+    DynamicArray_t(int) route;
+    assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+    da_deinit(int)(&route, NULL);
+
+    // change a few roads and repair the memo for all of them at once
+    uint64_t stale[3];
+    for (int i = 0; i < 3; i++) {
+      int a = rand() % city_cnt;
+      int b = (a + 1 + rand() % (city_cnt - 1)) % city_cnt;
+      assert(dm_update(&map.costs, a, b, rand() % 1000) && "could not update");
+      stale[i] = ((uint64_t)1 << a) | ((uint64_t)1 << b);
+    }
+    held_karp_repair(&map.costs, &ws.memo, &ws.combs, stale, 3);
+    assert(construct_tour(&ws.memo, &map.costs, &route, 0) && "no tour");
+    int64_t repaired = route_cost(&route, &map.costs, 0);
+    da_deinit(int)(&route, NULL);
+
+    Workspace_t fresh;
+    workspace_init(&fresh);
+    assert(solve_map(&map, &fresh, &opts, &route) && "could not solve");
+    assert(route_cost(&route, &map.costs, 0) == repaired && "bad repair");
+    da_deinit(int)(&route, NULL);
+
+    workspace_deinit(&fresh);
+    workspace_deinit(&ws);
+    random_map_deinit(&map);
+  }
+}
+
+// the cost of the shortest path that continues from curr over every city not
+// in visited, only along roads of costs->adj, or INT64_MAX if there is none.
+// If home isn't -1, the path also has to take a road back to home at the end
+static int64_t brute_force_path(DistanceMatrix_t *costs, int curr,
+                                uint64_t visited, int home) {
+  uint64_t all = ((uint64_t)1 << costs->city_cnt) - 1;
+  if (visited == all) {
+    if (home < 0 || home == curr)
+      return 0;
+
+    return costs->adj[curr] & ((uint64_t)1 << home) ? dm_get(costs, curr, home)
+                                                    : INT64_MAX;
+  }
+
+  int64_t best = INT64_MAX;
+  for (int next = 0; next < costs->city_cnt; next++) {
+    if ((visited & ((uint64_t)1 << next)) ||
+        !(costs->adj[curr] & ((uint64_t)1 << next)))
+      continue;
+
+    int64_t rest =
+        brute_force_path(costs, next, visited | ((uint64_t)1 << next), home);
+    if (rest != INT64_MAX && rest + dm_get(costs, curr, next) < best)
+      best = rest + dm_get(costs, curr, next);
+  }
+
+  return best;
+}
+
+void test_sparse_random() {
+  srand(32);
+  for (int city_cnt = 1; city_cnt <= 10; city_cnt++) {
+    for (int round = 0; round < 12; round++) {
+      Map_t map;
+      random_map(&map, city_cnt, round % 2 ? 100 : 100000);
+      // keep between a quarter and all of the roads, so some maps have no path
+      // over every city and some have plenty
+      int keep = 1 + round % 4;
+      for (int i = 0; i < city_cnt; i++) {
+        for (int j = i + 1; j < city_cnt; j++) {
+          if (rand() % 4 >= keep) {
+            dm_set(&map.costs, i, j, 0);
+            dm_set(&map.costs, j, i, 0);
+            continue;
+          }
+
+          map.costs.adj[i] |= (uint64_t)1 << j;
+          map.costs.adj[j] |= (uint64_t)1 << i;
+        }
+      }
+
+      int64_t expect = brute_force_path(&map.costs, 0, 1, -1);
+      Workspace_t ws;
+      workspace_init(&ws);
+      SolveOptions_t opts = {.sparse = 1};
+      DynamicArray_t(int) route;
+      if (expect == INT64_MAX) {
+        assert(!solve_map(&map, &ws, &opts, &route) && "solved without a path");
+      } else {
+        assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+        assert(route.len == (size_t)city_cnt && "bad route length");
+        assert(route.buf[route.len - 1] == 0 &&
+               "route doesn't start at city 0");
+        uint64_t seen = 0;
+        for (size_t i = 0; i < route.len; i++) {
+          assert(!(seen & ((uint64_t)1 << route.buf[i])) &&
+                 "city visited twice");
+          seen |= (uint64_t)1 << route.buf[i];
+          if (i > 0)
+            assert((map.costs.adj[route.buf[i]] &
+                    ((uint64_t)1 << route.buf[i - 1])) &&
+                   "route uses a missing road");
+        }
+
+        assert(route_cost(&route, &map.costs, 0) == expect && "not optimal");
+        da_deinit(int)(&route, NULL);
+      }
+
+      workspace_deinit(&ws);
+      random_map_deinit(&map);
+    }
+  }
+}
+
+// check that path visits every city of costs once, starting at start
+static void check_path(DynamicArray_t(int) * path, DistanceMatrix_t *costs,
+                       int start) {
+  assert(path->len == (size_t)costs->city_cnt && "bad path length");
+  assert(path->buf[path->len - 1] == start && "path doesn't start at start");
+  uint64_t seen = 0;
+  for (size_t i = 0; i < path->len; i++) {
+    assert(!(seen & ((uint64_t)1 << path->buf[i])) && "city visited twice");
+    seen |= (uint64_t)1 << path->buf[i];
+  }
+}
+
+// the same steps solve_all_starts takes for its table
+void test_all_starts() {
+  srand(29);
+  for (int city_cnt = 1; city_cnt <= 9; city_cnt++) {
+    for (int round = 0; round < 4; round++) {
+      Map_t map;
+      random_map(&map, city_cnt, round % 2 ? 100 : 100000);
+      // every road exists, so brute force can try them all
+      uint64_t all = ((uint64_t)1 << city_cnt) - 1;
+      for (int i = 0; i < city_cnt; i++)
+        map.costs.adj[i] = all & ~((uint64_t)1 << i);
+
+      Workspace_t ws;
+      workspace_init(&ws);
+      SolveOptions_t opts = {0};
+      DynamicArray_t(int) route;
+      assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+      da_deinit(int)(&route, NULL);
+
+      assert(construct_tour(&ws.memo, &map.costs, &route, 1) && "no tour");
+      check_path(&route, &map.costs, 0);
+      int64_t closed = route_cost(&route, &map.costs, 1);
+      da_deinit(int)(&route, NULL);
+
+      assert(held_karp_open(&map.costs, &ws.memo, &ws.combs) &&
+             "could not solve open paths");
+      for (int start = 0; start < city_cnt; start++) {
+        assert(construct_open_path(&ws.memo, &map.costs, start, &route) &&
+               "no path");
+        check_path(&route, &map.costs, start);
+        assert(route_cost(&route, &map.costs, 0) ==
+                   brute_force_path(&map.costs, start,
+                                    (uint64_t)1 << start, -1) &&
+               "bad open path");
+        da_deinit(int)(&route, NULL);
+
+        // the table shares one closed tour between all starts
+        assert(closed == brute_force_path(&map.costs, start,
+                                          (uint64_t)1 << start, start) &&
+               "bad closed tour");
+      }
+
+      workspace_deinit(&ws);
+      random_map_deinit(&map);
+    }
+  }
+}
+
+// parse buf with 1 to MAX_PARSE_THREADS jobs and check they all agree with the
+// single job on the cities, their order and the matrix
+static void check_parse_jobs(Str_t buf) {
+  DynamicArray_t(Str_t) expect_cities;
+  DistanceMatrix_t expect;
+  assert(da_init(Str_t)(&expect_cities, 16) && "could not allocate cities");
+  assert(parse_input_jobs(buf, 1, &expect_cities, &expect) &&
+         "could not parse");
+
+  for (size_t job_cnt = 2; job_cnt <= MAX_PARSE_THREADS; job_cnt++) {
+    DynamicArray_t(Str_t) cities;
+    DistanceMatrix_t costs;
+    assert(da_init(Str_t)(&cities, 16) && "could not allocate cities");
+    assert(parse_input_jobs(buf, job_cnt, &cities, &costs) &&
+           "could not parse with jobs");
+
+    assert(cities.len == expect_cities.len && "bad city count");
+    for (size_t i = 0; i < cities.len; i++)
+      assert(ss_eq(cities.buf[i], expect_cities.buf[i]) && "bad city order");
+
+    assert(costs.city_cnt == expect.city_cnt && costs.narrow == expect.narrow &&
+           "bad matrix");
+    for (int i = 0; i < costs.city_cnt; i++) {
+      assert(costs.adj[i] == expect.adj[i] && "bad neighbours");
+      for (int j = 0; j < costs.city_cnt; j++)
+        assert(dm_get(&costs, i, j) == dm_get(&expect, i, j) && "bad distance");
+    }
+
+    dm_deinit(&costs);
+    da_deinit(Str_t)(&cities, NULL);
+  }
+
+  dm_deinit(&expect);
+  da_deinit(Str_t)(&expect_cities, NULL);
+}
+
+void test_parse_jobs() {
+  Str_t data;
+  assert(mmap_file("tatooine.txt", &data) && "could not read map");
+  check_parse_jobs(data);
+  munmap_file(data);
+
+  srand(27);
+  static char buf[1 << 14];
+  for (int round = 0; round < 8; round++) {
+    // odd rounds have distances that only fit the wide matrix
+    int32_t max_dist = round % 2 ? 100000 : 1000;
+    size_t len = 0;
+    // with 20 cities, roads show up more than once, so the last line of each
+    // has to win
+    for (int line = 0; line < 150; line++) {
+      int a = rand() % 20, b = rand() % 20;
+      int32_t dist = rand() % max_dist;
+      const char *sign = rand() % 3 == 0 ? "-" : rand() % 2 ? "+" : "";
+      const char *end = rand() % 2 ? "\r\n" : "\n";
+      if (rand() % 8 == 0)
+        len += (size_t)snprintf(buf + len, sizeof(buf) - len, "%s",
+                                rand() % 2 ? "\n" : "  \r\n");
+      len += (size_t)snprintf(buf + len, sizeof(buf) - len,
+                              " City %d -City %d: %s%d%s", a, b, sign,
+                              (int)dist, end);
+    }
+    assert(len < sizeof(buf) && "synthetic map too big");
+
+    check_parse_jobs((Str_t){.s = buf, .len = len});
+    // the last line doesn't need a newline either
+    while (buf[len - 1] == '\n' || buf[len - 1] == '\r')
+      len--;
+    check_parse_jobs((Str_t){.s = buf, .len = len});
+  }
+}
+
+// a workspace that solved a bigger map before reuses its subsets for smaller
+// ones, the way batch workers do
+void test_workspace_reuse() {
+  srand(28);
+  Workspace_t ws;
+  workspace_init(&ws);
+  const int sizes[] = {10, 3, 7, 1, 10, 5, 12, 9};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    Map_t map;
+    random_map(&map, sizes[i], 1000);
+    // every road exists, so sparse solves always find a path
+    uint64_t all = ((uint64_t)1 << sizes[i]) - 1;
+    for (int j = 0; j < sizes[i]; j++)
+      map.costs.adj[j] = all & ~((uint64_t)1 << j);
+
+    for (int sparse = 0; sparse <= 1; sparse++) {
+      SolveOptions_t opts = {.sparse = sparse};
+      DynamicArray_t(int) route, expect;
+      assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+
+      Workspace_t fresh;
+      workspace_init(&fresh);
+      assert(solve_map(&map, &fresh, &opts, &expect) && "could not solve");
+      assert(route_cost(&route, &map.costs, 0) ==
+                 route_cost(&expect, &map.costs, 0) &&
+             "reused workspace solved differently");
+      da_deinit(int)(&expect, NULL);
+      da_deinit(int)(&route, NULL);
+      workspace_deinit(&fresh);
+    }
+
+    random_map_deinit(&map);
+  }
+
+  // the subsets were only generated for the biggest map
+  assert(ws.combs_n == 12 && "subsets regenerated for a smaller map");
+  workspace_deinit(&ws);
+}
+
+// check that result is a route over every city starting at city 0, that
+// costs what it says it does
+static void check_result(Map_t *map, JmResult_t *result) {
+  assert(result->city_cnt == (int)map->cities.len && "bad route length");
+  assert(result->route[0] == 0 && "route doesn't start at city 0");
+  uint64_t seen = 0;
+  int64_t cost = 0;
+  for (int i = 0; i < result->city_cnt; i++) {
+    assert(!(seen & ((uint64_t)1 << result->route[i])) && "city visited twice");
+    seen |= (uint64_t)1 << result->route[i];
+    if (i > 0)
+      cost += dm_get(&map->costs, result->route[i - 1], result->route[i]);
+  }
+
+  assert(cost == result->cost && "wrong route cost");
+  assert(result->lower_bound <= result->cost && "bound above the route");
+}
+
+void test_budgets() {
+  srand(40);
+  for (int city_cnt = 1; city_cnt <= 12; city_cnt++) {
+    Map_t map;
+    random_map(&map, city_cnt, city_cnt % 2 ? 100 : 100000);
+
+    int32_t dists[MAX_CITIES * MAX_CITIES];
+    for (int i = 0; i < city_cnt; i++)
+      for (int j = 0; j < city_cnt; j++)
+        dists[i * city_cnt + j] = dm_get(&map.costs, i, j);
+
+    Workspace_t ws;
+    workspace_init(&ws);
+    SolveOptions_t opts = {0};
+    DynamicArray_t(int) route;
+    assert(solve_map(&map, &ws, &opts, &route) && "could not solve");
+    int64_t optimum = route_cost(&route, &map.costs, 0);
+    da_deinit(int)(&route, NULL);
+    workspace_deinit(&ws);
+
+    // without limits, the result is exact
+    JmResult_t result;
+    assert(jm_solve(dists, city_cnt, NULL, &result) && "could not solve");
+    check_result(&map, &result);
+    assert(result.optimal && result.cost == optimum && "not optimal");
+
+    // nothing fits in a single byte, so only the heuristic runs
+    JmBudget_t tiny_memory = {.memory_budget = 1};
+    assert(jm_solve(dists, city_cnt, &tiny_memory, &result) && "no result");
+    check_result(&map, &result);
+    assert(result.lower_bound <= optimum && "bound above the optimum");
+    assert((result.optimal || result.method == JM_HEURISTIC) &&
+           "exact solver over the memory budget");
+
+    // meeting in the middle needs a lot less memory than Held-Karp, once
+    // there are enough cities
+    if (mitm_memory(city_cnt) < held_karp_memory(city_cnt)) {
+      JmBudget_t no_memo = {.memory_budget =
+                                (size_t)held_karp_memory(city_cnt) - 1};
+      assert(jm_solve(dists, city_cnt, &no_memo, &result) && "no result");
+      check_result(&map, &result);
+      assert(result.optimal && result.cost == optimum && "not optimal");
+      assert(result.method != JM_HELD_KARP && "held karp over the budget");
+    }
+
+    // there's always a route, no matter how little time there is
+    JmBudget_t tiny_time = {.time_budget = 1e-9};
+    assert(jm_solve(dists, city_cnt, &tiny_time, &result) && "no result");
+    check_result(&map, &result);
+    assert(result.lower_bound <= optimum && "bound above the optimum");
+
+    random_map_deinit(&map);
+  }
+}
+
+int main(void) {
+  test_mitm_random();
+  test_mitm_files();
+  test_cache_relabel();
+  test_compiled_maps();
+  test_repair();
+  test_sparse_random();
+  test_all_starts();
+  test_parse_jobs();
+  test_workspace_reuse();
+  test_budgets();
+  return 0;
+}
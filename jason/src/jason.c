@@ -1,5 +1,7 @@
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,13 +12,26 @@
 #include "../../std.h/include/string.h"
 
 #include "../../std.h/include/hash_map.h"
+#define ALLOC_IMPL
+// we still need malloc and friends
+#define ALLOC_NO_SHORTHANDS
+#include "../../std.h/include/allocator.h"
 
+#include "json_pow10.h"
 #include "neurolib.h"
 
+// stage 1 has vectorized versions for x86, picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_X86
+#include <immintrin.h>
+#endif
+
 typedef enum {
   JSON_NULL,
   JSON_STRING,
   JSON_NUMBER,
+  // only if the document asked for exact integers
+  JSON_INTEGER,
   JSON_BOOL,
   JSON_ARRAY,
   JSON_OBJECT
@@ -26,16 +41,19 @@ typedef union JsonValue JsonValue_t;
 typedef struct TaggedJsonValue TaggedJsonValue_t;
 
 DA_DECLARE(TaggedJsonValue_t)
-HM_DECLARE(String_t, TaggedJsonValue_t)
+HM_DECLARE(Str_t, TaggedJsonValue_t)
 
 // an object is just a hashmap of elements
-typedef HashMap_t(String_t, TaggedJsonValue_t) JsonObject_t;
+typedef HashMap_t(Str_t, TaggedJsonValue_t) JsonObject_t;
 // an array is just a dynamic array of elements
 typedef DynamicArray_t(TaggedJsonValue_t) JsonArray_t;
 
 union JsonValue {
-  String_t string;
+  // strings without escape sequences point straight into the parsed input,
+  // the rest are decoded into the document
+  Str_t string;
   double number;
+  int64_t integer;
   bool boolean;
   JsonArray_t array;
   JsonObject_t object;
@@ -46,56 +64,173 @@ struct TaggedJsonValue {
   JsonType_t type;
 };
 
-HM_IMPL(String_t, TaggedJsonValue_t)
+HM_IMPL(Str_t, TaggedJsonValue_t)
 DA_IMPL(TaggedJsonValue_t)
 
 // djb2 hashing algorithm
-uint64_t s_hash(String_t *s) {
+uint64_t json_key_hash(Str_t *s) {
   uint64_t hash = 5381;
-  Str_t s_slice = s_str(s);
-  int c;
 
-  while ((c = ss_advance_once(&s_slice)))
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+  for (size_t i = 0; i < s->len; i++)
+    hash = ((hash << 5) + hash) + (uint8_t)s->s[i]; /* hash * 33 + c */
 
   return hash;
 }
 
-int s_eq(String_t *a, String_t *b) {
-  if (a->len != b->len)
+int json_key_eq(Str_t *a, Str_t *b) {
+  return a->len == b->len && (a->s == b->s || memcmp(a->s, b->s, a->len) == 0);
+}
+
+static Mallocator_t json_mallocator = {.fns = &mallocator_fns};
+
+HM_DECLARE_IMPL(Str_t, uint64_t)
+
+// json_keys_slot picks one of these with the top 8 bits of a product
+#define JSON_KEYS_RECENT 256
+
+// A JsonKeys_t interns object keys across documents. Every document parsed
+// with the same table shares a single copy of each distinct key, so keys that
+// are equal are the same pointer, and each one is hashed and given an ID only
+// the first time it is seen. The table only ever grows, and has to outlive
+// every document parsed with it
+typedef struct {
+  // every distinct key, mapped to its ID
+  HashMap_t(Str_t, uint64_t) ids;
+  // where the keys are copied to
+  ArenaAllocator_t arena;
+  // the last key seen in each slot, picked by json_keys_slot. Most keys are
+  // found here, without being hashed
+  Str_t recent[JSON_KEYS_RECENT];
+} JsonKeys_t;
+
+// interned keys are stored right after this
+typedef struct {
+  uint64_t hash;
+  uint64_t id;
+} JsonKeyHeader_t;
+
+// the size of the chunks the keys are copied into
+#define JSON_KEYS_CHUNK (4 * 1024)
+// the number of keys a table starts out with room for
+#define JSON_KEYS_CAP 64
+
+// Upon success, the caller is responsible for deiniting keys
+int json_keys_init(JsonKeys_t *keys) {
+  if (!hm_init(Str_t, uint64_t)(&keys->ids, JSON_KEYS_CAP, json_key_hash,
+                                json_key_eq))
     return 0;
 
-  for (size_t i = 0; i < a->len; i++)
-    if (a->buf[i] != b->buf[i])
-      return 0;
+  if (!arena_init(&keys->arena, JSON_KEYS_CHUNK, &json_mallocator)) {
+    hm_deinit(Str_t, uint64_t)(&keys->ids, NULL);
+    return 0;
+  }
 
+  memset(keys->recent, 0, sizeof(keys->recent));
   return 1;
 }
 
-void json_deinit(TaggedJsonValue_t value);
+void json_keys_deinit(JsonKeys_t *keys) {
+  hm_deinit(Str_t, uint64_t)(&keys->ids, NULL);
+  arena_deinit(&keys->arena);
+}
 
-void json_object_kv_deinit(KVPair_t(String_t, TaggedJsonValue_t) entry) {
-  s_deinit(&entry.k);
-  json_deinit(entry.v);
+static const JsonKeyHeader_t *json_key_header(Str_t key) {
+  return (const JsonKeyHeader_t *)key.s - 1;
 }
 
-void json_deinit(TaggedJsonValue_t value) {
-  switch (value.type) {
-  case JSON_NULL:
-  case JSON_BOOL:
-  case JSON_NUMBER:
-    break;
-  case JSON_STRING:
-    s_deinit(&value.el.string);
-    break;
-  case JSON_ARRAY:
-    da_deinit(TaggedJsonValue_t)(&value.el.array, json_deinit);
-    break;
-  case JSON_OBJECT:
-    hm_deinit(String_t, TaggedJsonValue_t)(&value.el.object,
-                                           json_object_kv_deinit);
-    break;
+// the ID of a key returned by json_keys_intern. IDs start at 1 and go up by
+// one for every new key
+uint64_t json_key_id(Str_t key) { return json_key_header(key)->id; }
+
+// where key goes in recent, from its length and its first and last bytes,
+// mixed by a multiplication that spreads them over the top bits
+static size_t json_keys_slot(Str_t key) {
+  uint64_t guess = key.len;
+  if (key.len)
+    guess |= (uint64_t)(uint8_t)key.s[0] << 32 |
+             (uint64_t)(uint8_t)key.s[key.len - 1] << 40;
+  return (guess * 0x9E3779B97F4A7C15ULL) >> 56;
+}
+
+// the copy of key that keys holds, which is made if there isn't one yet. Fails
+// with a NULL .s
+Str_t json_keys_intern(JsonKeys_t *keys, Str_t key) {
+  Str_t *recent = keys->recent + json_keys_slot(key);
+  if (recent->s && json_key_eq(recent, &key))
+    return *recent;
+
+  Str_t interned = {0};
+  uint64_t hash = json_key_hash(&key);
+  KVPair_t(Str_t, uint64_t) *entry = hm_function_call(
+      hm_get_entry_raw, Str_t, uint64_t)(&keys->ids, &key, hash);
+  if (entry && entry->occupied) {
+    *recent = entry->k;
+    return entry->k;
   }
+
+  JsonKeyHeader_t *header = (JsonKeyHeader_t *)arena_alloc(
+      &keys->arena, sizeof(JsonKeyHeader_t) + key.len);
+  if (!header)
+    return interned;
+
+  header->hash = hash;
+  header->id = keys->ids.len + 1;
+  memcpy(header + 1, key.s, key.len);
+  interned.s = (const char *)(header + 1);
+  interned.len = key.len;
+  // this only happens once per key, so hashing it again doesn't matter. If
+  // it fails the copy stays in the arena unused
+  if (!hm_put(Str_t, uint64_t)(&keys->ids, interned, header->id))
+    interned.s = NULL;
+  else
+    *recent = interned;
+  return interned;
+}
+
+// a parsed JSON value along with the memory it lives in
+typedef struct {
+  TaggedJsonValue_t root;
+  // every string, array and object in root is allocated from here, so the
+  // whole tree is freed at once
+  ArenaAllocator_t arena;
+  // most strings in root point into the input, so it has to stay around for
+  // as long as the document does. If this is set, the document owns the input
+  // and frees it along with everything else
+  char *input;
+  // if set, numbers without a fraction or exponent that fit in an int64_t are
+  // kept as exact JSON_INTEGERs instead of being rounded to doubles
+  bool exact_integers;
+  // if set, object keys are interned in this table, which can be shared by
+  // any number of documents. Keys then point into the table instead of the
+  // input, and can be looked up with json_object_get_interned
+  JsonKeys_t *keys;
+} JsonDocument_t;
+
+// the size of the chunks a document grows by
+#define JSON_ARENA_CHUNK (64 * 1024)
+
+// Upon success, the caller is responsible for deiniting doc
+int json_document_init(JsonDocument_t *doc) {
+  memset(&doc->root, 0, sizeof(TaggedJsonValue_t));
+  doc->input = NULL;
+  doc->exact_integers = false;
+  doc->keys = NULL;
+  return arena_init(&doc->arena, JSON_ARENA_CHUNK, &json_mallocator);
+}
+
+// free everything doc holds, but keep its memory around for the next value
+static void json_document_reset(JsonDocument_t *doc) {
+  arena_reset(&doc->arena);
+  free(doc->input);
+  doc->input = NULL;
+  memset(&doc->root, 0, sizeof(TaggedJsonValue_t));
+}
+
+void json_document_deinit(JsonDocument_t *doc) {
+  arena_deinit(&doc->arena);
+  free(doc->input);
+  doc->input = NULL;
+  memset(&doc->root, 0, sizeof(TaggedJsonValue_t));
 }
 
 int handle_escape_sequence(String_t *result, Str_t *s) {
@@ -152,370 +287,2221 @@ int handle_escape_sequence(String_t *result, Str_t *s) {
   }
 }
 
-int json_parse_string(Str_t *s, String_t *result) {
-  *s = ss_trim_left(*s);
+// Parsing happens in two stages. The first one finds every structural
+// character({}[]:,), every quote that isn't escaped and the start of every
+// other scalar(numbers, true, false and null) outside of strings, 64 bytes at
+// a time, and writes their positions into an index. The second one walks the
+// index to build values, so it never has to look at whitespace or the insides
+// of strings to find out where the next value starts
+
+// classes of characters stage 1 looks for
+#define JSON_CLASS_QUOTE 1
+#define JSON_CLASS_BACKSLASH 2
+#define JSON_CLASS_WHITESPACE 4
+#define JSON_CLASS_OP 8
+
+static const uint8_t json_char_class[256] = {
+    ['"'] = JSON_CLASS_QUOTE,      ['\\'] = JSON_CLASS_BACKSLASH,
+    [' '] = JSON_CLASS_WHITESPACE, ['\t'] = JSON_CLASS_WHITESPACE,
+    ['\n'] = JSON_CLASS_WHITESPACE, ['\r'] = JSON_CLASS_WHITESPACE,
+    ['{'] = JSON_CLASS_OP,         ['}'] = JSON_CLASS_OP,
+    ['['] = JSON_CLASS_OP,         [']'] = JSON_CLASS_OP,
+    [':'] = JSON_CLASS_OP,         [','] = JSON_CLASS_OP,
+};
+
+// the characters of a 64 byte block that stage 1 cares about, one bit per byte
+typedef struct {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t whitespace;
+  uint64_t op;
+} JsonBlock_t;
+
+static void json_classify_scalar(const uint8_t *block, JsonBlock_t *res) {
+  memset(res, 0, sizeof(JsonBlock_t));
+  for (int i = 0; i < 64; i++) {
+    uint8_t class = json_char_class[block[i]];
+    uint64_t bit = (uint64_t)1 << i;
+    if (class & JSON_CLASS_QUOTE)
+      res->quote |= bit;
+    if (class & JSON_CLASS_BACKSLASH)
+      res->backslash |= bit;
+    if (class & JSON_CLASS_WHITESPACE)
+      res->whitespace |= bit;
+    if (class & JSON_CLASS_OP)
+      res->op |= bit;
+  }
+}
+
+#ifdef JSON_X86
+// a mask of the bytes of v that equal c
+#define sse2_eq(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define sse2_bits(v) ((uint64_t)(uint16_t)_mm_movemask_epi8(v))
+
+__attribute__((target("sse2"))) static void
+json_classify_sse2(const uint8_t *block, JsonBlock_t *res) {
+  memset(res, 0, sizeof(JsonBlock_t));
+  for (int i = 0; i < 4; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+    __m128i ws = _mm_or_si128(_mm_or_si128(sse2_eq(v, ' '), sse2_eq(v, '\t')),
+                              _mm_or_si128(sse2_eq(v, '\n'), sse2_eq(v, '\r')));
+    __m128i op = _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(sse2_eq(v, '{'), sse2_eq(v, '}')),
+                     _mm_or_si128(sse2_eq(v, '['), sse2_eq(v, ']'))),
+        _mm_or_si128(sse2_eq(v, ':'), sse2_eq(v, ',')));
+
+    res->quote |= sse2_bits(sse2_eq(v, '"')) << (16 * i);
+    res->backslash |= sse2_bits(sse2_eq(v, '\\')) << (16 * i);
+    res->whitespace |= sse2_bits(ws) << (16 * i);
+    res->op |= sse2_bits(op) << (16 * i);
+  }
+}
+
+#define avx2_eq(v, c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define avx2_bits(v) ((uint64_t)(uint32_t)_mm256_movemask_epi8(v))
+
+__attribute__((target("avx2"))) static void
+json_classify_avx2(const uint8_t *block, JsonBlock_t *res) {
+  memset(res, 0, sizeof(JsonBlock_t));
+  for (int i = 0; i < 2; i++) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(block + 32 * i));
+    __m256i ws =
+        _mm256_or_si256(_mm256_or_si256(avx2_eq(v, ' '), avx2_eq(v, '\t')),
+                        _mm256_or_si256(avx2_eq(v, '\n'), avx2_eq(v, '\r')));
+    __m256i op = _mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(avx2_eq(v, '{'), avx2_eq(v, '}')),
+                        _mm256_or_si256(avx2_eq(v, '['), avx2_eq(v, ']'))),
+        _mm256_or_si256(avx2_eq(v, ':'), avx2_eq(v, ',')));
+
+    res->quote |= avx2_bits(avx2_eq(v, '"')) << (32 * i);
+    res->backslash |= avx2_bits(avx2_eq(v, '\\')) << (32 * i);
+    res->whitespace |= avx2_bits(ws) << (32 * i);
+    res->op |= avx2_bits(op) << (32 * i);
+  }
+}
+#endif
+
+// the characters of a block escaped by a backslash. prev_escaped is set if the
+// first character of the block is escaped by the previous one, and is updated
+// for the next block. Odd runs of backslashes escape the character after them,
+// even ones don't
+static uint64_t json_find_escaped(uint64_t backslash, uint64_t *prev_escaped) {
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  // an escaped backslash doesn't escape anything
+  backslash &= ~*prev_escaped;
+  uint64_t follows_escape = backslash << 1 | *prev_escaped;
+  // adding the start of every run that starts on an odd bit to the backslashes
+  // carries through the run, leaving only the bit after it set
+  uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+  uint64_t even_starts = odd_starts + backslash;
+  *prev_escaped = even_starts < backslash;
+  // even_starts now has the runs that start on even bits, so flipping them
+  // gives every character that comes after an odd amount of backslashes
+  return (even_bits ^ (even_starts << 1)) & follows_escape;
+}
+
+// bit i of the result is the xor of bits 0 to i of x
+static uint64_t json_prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+// write the position of every set bit of bits into index, offset by base
+static size_t json_flatten(uint32_t *index, size_t cnt, size_t base,
+                           uint64_t bits) {
+  while (bits) {
+    index[cnt++] = (uint32_t)(base + __builtin_ctzll(bits));
+    bits &= bits - 1;
+  }
+
+  return cnt;
+}
+
+// the body of stage 1 using classify to find the characters of each block.
+// Writes at most len entries to index and returns how many it wrote. If the
+// input ends inside of a string, *unterminated is set
+#define JSON_INDEX_KERNEL(name, classify)                                      \
+  static size_t name(const uint8_t *buf, size_t len, uint32_t *index,          \
+                     int *unterminated) {                                      \
+    uint64_t prev_escaped = 0, prev_in_string = 0, prev_scalar = 0;            \
+    size_t cnt = 0;                                                            \
+    uint8_t tail[64];                                                          \
+    for (size_t base = 0; base < len; base += 64) {                            \
+      const uint8_t *block = buf + base;                                       \
+      /* the last block is padded with whitespace */                           \
+      if (len - base < 64) {                                                   \
+        memset(tail, ' ', sizeof(tail));                                       \
+        memcpy(tail, block, len - base);                                       \
+        block = tail;                                                          \
+      }                                                                        \
+                                                                               \
+      JsonBlock_t b;                                                           \
+      classify(block, &b);                                                     \
+                                                                               \
+      uint64_t escaped = json_find_escaped(b.backslash, &prev_escaped);        \
+      uint64_t quote = b.quote & ~escaped;                                     \
+      /* everything from an opening quote up to its closing one */            \
+      uint64_t in_string = json_prefix_xor(quote) ^ prev_in_string;            \
+      prev_in_string = 0 - (in_string >> 63);                                  \
+                                                                               \
+      /* scalars start at anything that isn't whitespace or an op, unless it   \
+       * comes right after another such character */                           \
+      uint64_t scalar = ~(b.op | b.whitespace);                                \
+      uint64_t nonquote_scalar = scalar & ~quote;                              \
+      uint64_t follows_scalar = nonquote_scalar << 1 | prev_scalar;            \
+      prev_scalar = nonquote_scalar >> 63;                                     \
+                                                                               \
+      uint64_t structural =                                                    \
+          ((b.op | (scalar & ~follows_scalar)) & ~in_string) | quote;          \
+      cnt = json_flatten(index, cnt, base, structural);                        \
+    }                                                                          \
+                                                                               \
+    *unterminated = prev_in_string != 0;                                       \
+    return cnt;                                                                \
+  }
+
+JSON_INDEX_KERNEL(json_index_scalar, json_classify_scalar)
+#ifdef JSON_X86
+__attribute__((target("sse2")))
+JSON_INDEX_KERNEL(json_index_sse2, json_classify_sse2)
+__attribute__((target("avx2")))
+JSON_INDEX_KERNEL(json_index_avx2, json_classify_avx2)
+#endif
+
+typedef size_t (*JsonIndexKernel_t)(const uint8_t *buf, size_t len,
+                                    uint32_t *index, int *unterminated);
+
+// the fastest stage 1 the cpu we are running on supports
+static JsonIndexKernel_t json_index_kernel(void) {
+#ifdef JSON_X86
+  if (__builtin_cpu_supports("avx2"))
+    return json_index_avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return json_index_sse2;
+#endif
+  return json_index_scalar;
+}
+
+typedef struct {
+  Str_t src;
+  // the positions of all structural characters, quotes and scalars of src
+  uint32_t *index;
+  size_t index_len;
+  // the next entry of index stage 2 is going to look at
+  size_t pos;
+  // where the values are allocated
+  ArenaAllocator_t *arena;
+  // the elements of unfinished arrays and the keys and values of unfinished
+  // objects. Containers are only allocated once they are done and their size
+  // is known
+  JsonArray_t stack;
+  // see JsonDocument_t
+  bool exact_integers;
+  JsonKeys_t *keys;
+} JsonParser_t;
+
+// run stage 1 over s
+// Upon success, the caller is responsible for freeing parser->index
+int json_index(JsonParser_t *parser, Str_t s) {
+  memset(parser, 0, sizeof(JsonParser_t));
+  // positions are stored as 32 bits to keep the index small
+  if (s.len > UINT32_MAX)
+    return 0;
+
+  // every byte can be in the index at most once
+  parser->index = (uint32_t *)malloc((s.len + 1) * sizeof(uint32_t));
+  if (!parser->index)
+    return 0;
 
-  if (s->len == 0 || *s->s != '"')
+  int unterminated;
+  parser->src = s;
+  parser->index_len = json_index_kernel()((const uint8_t *)s.s, s.len,
+                                          parser->index, &unterminated);
+  if (unterminated) {
+    free(parser->index);
+    parser->index = NULL;
     return 0;
+  }
+
+  return 1;
+}
 
-  // TODO: maybe handle this using an enum to differentiate between errors
-  if (!s_init(result, 16))
+// the character at the next position of the index, 0 if there is none
+static char json_peek(JsonParser_t *parser) {
+  if (parser->pos >= parser->index_len)
+    return '\0';
+
+  return parser->src.s[parser->index[parser->pos]];
+}
+
+// check that the scalar that started at the current position ends at end,
+// instead of going on with more characters, and move past it
+static int json_end_scalar(JsonParser_t *parser, size_t end) {
+  if (end < parser->src.len &&
+      !(json_char_class[(uint8_t)parser->src.s[end]] &
+        (JSON_CLASS_WHITESPACE | JSON_CLASS_OP | JSON_CLASS_QUOTE)))
     return 0;
 
-  // skip the " character
-  // won't fail
-  ss_advance_once(s);
-  while (s->len > 0) {
+  parser->pos++;
+  return 1;
+}
+
+// returned by json_plain_prefix if a string contains a control character
+#define JSON_CONTROL_CHAR SIZE_MAX
+
+// the length of the part of the contents of a string before its first escape
+// sequence
+static size_t json_plain_prefix(Str_t s) {
+  size_t plain = 0;
+  for (; plain < s.len; plain++) {
+    char c = s.s[plain];
+    // filter control characters
+    if (c >= 0 && c < ' ')
+      return JSON_CONTROL_CHAR;
+    if (c == '\\')
+      break;
+  }
+
+  return plain;
+}
+
+// decode the contents of a string that has an escape sequence after its first
+// plain bytes into result, which must have room for all of s
+static int json_decode_string(Str_t s, size_t plain, String_t *result) {
+  memcpy(result->buf, s.s, plain);
+  result->len = plain;
+  ss_advance(&s, plain);
+  while (s.len > 0) {
     // won't fail becasue len is at least 1
-    int next_char = ss_advance_once(s);
+    int next_char = ss_advance_once(&s);
 
     // filter control characters
     if (next_char >= 0 && next_char < ' ')
-      break;
+      return 0;
 
-    switch (next_char) {
-      // end of string
-    case '"':
-      return 1;
-    case '\\':
+    if (next_char == '\\') {
       // if we can't properly handle the escape sequence, we have a skill issue
       // and fail
-      if (!handle_escape_sequence(result, s)) {
-        s_deinit(result);
+      if (!handle_escape_sequence(result, &s))
         return 0;
-      }
-      break;
-    default:
+    } else if (!s_push(result, next_char)) {
       // otherwise just append to the end of the string
-      if (!s_push(result, next_char)) {
-        s_deinit(result);
-        return 0;
-      }
+      return 0;
     }
   }
 
-  s_deinit(result);
-  return 0;
+  return 1;
 }
 
-// s needs to be null terminated for this function to work properly
-int json_parse_number(Str_t *s, double *res) {
-  char *end;
-  errno = 0;
-  // notice we can safely pass s->s into strtod because it is null terminated
-  *res = strtod(s->s, &end);
-  if (end == s->s || errno)
+int json_parse_string(JsonParser_t *parser, Str_t *result) {
+  if (json_peek(parser) != '"')
+    return 0;
+
+  // stage 1 always indexes the closing quote right after the opening one
+  size_t open = parser->index[parser->pos];
+  size_t close = parser->index[parser->pos + 1];
+  Str_t s = {.s = parser->src.s + open + 1, .len = close - open - 1};
+
+  size_t plain = json_plain_prefix(s);
+  if (plain == JSON_CONTROL_CHAR)
     return 0;
 
-  size_t advance_bytes = end - s->s;
-  ss_advance(s, advance_bytes);
+  // without escape sequences the string is just the input between the quotes
+  if (plain == s.len) {
+    *result = s;
+    parser->pos += 2;
+    return 1;
+  }
+
+  // escape sequences only ever make strings shorter, so decoded never has to
+  // grow out of the arena
+  String_t decoded = {.cap = s.len};
+  decoded.buf = (char *)arena_alloc(parser->arena, s.len);
+  if (!decoded.buf || !json_decode_string(s, plain, &decoded))
+    return 0;
 
+  *result = s_str(&decoded);
+  parser->pos += 2;
   return 1;
 }
 
-int json_parse_boolean(Str_t *s, bool *result) {
-  *s = ss_trim_left(*s);
-  Str_t true_string = ss_from_cstring("true");
-  Str_t false_string = ss_from_cstring("false");
+// a number as it is written, split into the parts it is converted from
+typedef struct {
+  // the first 19 significant digits, which always fit
+  uint64_t mantissa;
+  // the power of 10 the mantissa is multiplied by
+  int64_t exp10;
+  bool negative;
+  // there is no fraction or exponent
+  bool integer;
+  // there were more than 19 significant digits, and the rest were cut off
+  bool truncated;
+} JsonNumberParts_t;
+
+// the most digits that always fit in a uint64_t
+#define JSON_MANTISSA_DIGITS 19
+// exponents stop growing at this while they are parsed, anything this big
+// overflows or underflows anyway
+#define JSON_EXPONENT_LIMIT 100000
+
+// the end of the number that starts at start, following the JSON grammar
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, which is split into parts on
+// the way. Returns start if there is no valid number there
+static size_t json_scan_number(Str_t src, size_t start,
+                               JsonNumberParts_t *parts) {
+  memset(parts, 0, sizeof(JsonNumberParts_t));
+  size_t i = start;
+  if (i < src.len && src.s[i] == '-') {
+    parts->negative = true;
+    i++;
+  }
 
-  if (ss_starts_with(*s, true_string)) {
-    *result = true;
-    ss_advance(s, true_string.len);
+  // digits past the 19th overflow mantissa here, which is fixed below
+  uint64_t mantissa = 0;
+  size_t int_start = i;
+  if (i < src.len && src.s[i] == '0') {
+    i++;
+  } else if (i < src.len && src.s[i] >= '1' && src.s[i] <= '9') {
+    while (i < src.len && isdigit((uint8_t)src.s[i]))
+      mantissa = mantissa * 10 + (uint64_t)(src.s[i++] - '0');
+  } else {
+    return start;
+  }
+
+  size_t int_end = i;
+  size_t frac_start = i;
+  size_t frac_end = i;
+  if (i < src.len && src.s[i] == '.') {
+    frac_start = ++i;
+    while (i < src.len && isdigit((uint8_t)src.s[i]))
+      mantissa = mantissa * 10 + (uint64_t)(src.s[i++] - '0');
+    if (i == frac_start)
+      return start;
+    frac_end = i;
+  }
+
+  int64_t exponent = 0;
+  if (i < src.len && (src.s[i] == 'e' || src.s[i] == 'E')) {
+    i++;
+    bool negative = false;
+    if (i < src.len && (src.s[i] == '+' || src.s[i] == '-'))
+      negative = src.s[i++] == '-';
+    size_t digits = i;
+    for (; i < src.len && isdigit((uint8_t)src.s[i]); i++)
+      if (exponent < JSON_EXPONENT_LIMIT)
+        exponent = exponent * 10 + (src.s[i] - '0');
+    if (i == digits)
+      return start;
+    if (negative)
+      exponent = -exponent;
+  } else {
+    parts->integer = frac_start == frac_end;
+  }
+
+  parts->mantissa = mantissa;
+  parts->exp10 = exponent - (int64_t)(frac_end - frac_start);
+
+  size_t digits = (int_end - int_start) + (frac_end - frac_start);
+  if (digits <= JSON_MANTISSA_DIGITS)
+    return i;
+
+  // leading zeros, like the ones in 0.0001, don't count
+  size_t p = int_start;
+  for (; p < frac_end && (src.s[p] == '0' || src.s[p] == '.'); p++)
+    if (src.s[p] == '0')
+      digits--;
+  if (digits <= JSON_MANTISSA_DIGITS)
+    return i;
+
+  // keep the first 19 digits, the exponent makes up for the ones in the
+  // integer part that were cut off, and only counts the fraction digits that
+  // were kept
+  parts->truncated = true;
+  mantissa = 0;
+  for (size_t taken = 0; taken < JSON_MANTISSA_DIGITS; p++) {
+    if (src.s[p] == '.')
+      continue;
+    mantissa = mantissa * 10 + (uint64_t)(src.s[p] - '0');
+    taken++;
+  }
+
+  parts->mantissa = mantissa;
+  if (p <= int_end)
+    parts->exp10 = exponent + (int64_t)(int_end - p);
+  else
+    parts->exp10 = exponent - (int64_t)(p - frac_start);
+  return i;
+}
+
+// the number n, if it is an integer that fits in an int64_t
+static bool json_number_to_integer(const JsonNumberParts_t *n, int64_t *res) {
+  if (!n->integer || n->truncated)
+    return false;
+
+  if (!n->negative) {
+    if (n->mantissa > (uint64_t)INT64_MAX)
+      return false;
+    *res = (int64_t)n->mantissa;
+    return true;
+  }
+
+  if (n->mantissa > (uint64_t)INT64_MAX + 1)
+    return false;
+  *res = n->mantissa == (uint64_t)INT64_MAX + 1 ? INT64_MIN
+                                                 : -(int64_t)n->mantissa;
+  return true;
+}
+
+// integers up to this convert to doubles exactly
+#define JSON_EXACT_INTEGER (1ULL << 53)
+
+// the powers of 10 that are exact as doubles
+static const double json_pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define JSON_POW10_EXACT_MAX 22
+
+// the high half of a * b, with the low half in lo
+static uint64_t json_mul128(uint64_t a, uint64_t b, uint64_t *lo) {
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 json_u128;
+  json_u128 product = (json_u128)a * b;
+  *lo = (uint64_t)product;
+  return (uint64_t)(product >> 64);
+#else
+  uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+  uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+  uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+  uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+  *lo = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+  return hi_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+// mantissa * 10^exp10 rounded to the nearest double, using the Eisel-Lemire
+// algorithm: the mantissa is multiplied by the first 128 bits of the power of
+// 10, which is almost always enough to tell how to round. mantissa can't be 0
+// and exp10 has to be within the table. Fails if the result is subnormal or
+// infinite, or if it can't be rounded without all of the digits of the power
+// of 10, in which case the caller has to do it the slow way
+static int json_eisel_lemire(uint64_t mantissa, int64_t exp10, bool negative,
+                             double *res) {
+  const uint64_t *pow10 = json_pow10_128[exp10 - JSON_POW10_MIN];
+
+  // normalize the mantissa so its top bit is set
+  int clz = __builtin_clzll(mantissa);
+  mantissa <<= clz;
+  // 217706 / 2^16 is just above log2(10), which is exact enough for the
+  // exponents in the table
+  int64_t exp2 = ((217706 * exp10) >> 16) + 64 + 1023 - clz;
+
+  uint64_t lo;
+  uint64_t hi = json_mul128(mantissa, pow10[0], &lo);
+  // the bits below the 54 we keep are all ones, so the error from the cut off
+  // half of the power of 10 could carry into them. Bring the second half in
+  if ((hi & 0x1FF) == 0x1FF && lo + mantissa < mantissa) {
+    uint64_t low_lo;
+    uint64_t low_hi = json_mul128(mantissa, pow10[1], &low_lo);
+    uint64_t merged_hi = hi, merged_lo = lo + low_hi;
+    if (merged_lo < lo)
+      merged_hi++;
+    // even all 128 bits aren't enough
+    if ((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 &&
+        low_lo + mantissa < mantissa)
+      return 0;
+    hi = merged_hi;
+    lo = merged_lo;
+  }
+
+  // keep 54 bits, one more than a double has, to round with
+  uint64_t msb = hi >> 63;
+  uint64_t bits = hi >> (msb + 9);
+  exp2 -= 1 ^ msb;
+
+  // exactly halfway between two doubles, which only the rest of the digits of
+  // the power of 10 could decide
+  if (lo == 0 && (hi & 0x1FF) == 0 && (bits & 3) == 1)
+    return 0;
+
+  bits += bits & 1;
+  bits >>= 1;
+  // rounding up overflowed into another bit
+  if (bits >> 53) {
+    bits >>= 1;
+    exp2++;
+  }
+
+  if (exp2 <= 0 || exp2 >= 0x7FF)
+    return 0;
+
+  bits = (uint64_t)exp2 << 52 | (bits & ((1ULL << 52) - 1));
+  if (negative)
+    bits |= 1ULL << 63;
+  memcpy(res, &bits, sizeof(double));
+  return 1;
+}
+
+// numbers longer than this are copied to the heap for strtod
+#define JSON_NUMBER_BUF 64
+
+// convert s, which has to be exactly one number, with strtod. Only used for
+// the few numbers json_eisel_lemire can't round
+static int json_number_slow(Str_t s, double *res) {
+  // s doesn't have to be null terminated, so strtod gets a terminated copy
+  // of just the number
+  char stack_buf[JSON_NUMBER_BUF];
+  char *buf = stack_buf;
+  if (s.len >= JSON_NUMBER_BUF) {
+    buf = (char *)malloc(s.len + 1);
+    if (!buf)
+      return 0;
+  }
+  memcpy(buf, s.s, s.len);
+  buf[s.len] = '\0';
+
+  char *num_end;
+  *res = strtod(buf, &num_end);
+  // numbers too small for a double are fine as 0 or subnormals, the ones too
+  // big for it aren't
+  int ok = num_end == buf + s.len && !isinf(*res);
+  if (buf != stack_buf)
+    free(buf);
+  return ok;
+}
+
+// convert the number n, which was split out of s, to the nearest double
+static int json_number_to_double(const JsonNumberParts_t *n, Str_t s,
+                                 double *res) {
+  // both the mantissa and the power of 10 are exact, so a single
+  // multiplication or division rounds correctly. Unless the FPU works in
+  // extended precision, in which case only integers are safe
+  if (!n->truncated && n->mantissa <= JSON_EXACT_INTEGER &&
+      (n->exp10 == 0 ||
+       (FLT_EVAL_METHOD == 0 && n->exp10 >= -JSON_POW10_EXACT_MAX &&
+        n->exp10 <= JSON_POW10_EXACT_MAX))) {
+    double d = (double)n->mantissa;
+    if (n->exp10 < 0)
+      d /= json_pow10_exact[-n->exp10];
+    else
+      d *= json_pow10_exact[n->exp10];
+    *res = n->negative ? -d : d;
     return 1;
-  } else if (ss_starts_with(*s, false_string)) {
-    *result = false;
-    ss_advance(s, false_string.len);
+  }
+
+  if (n->mantissa == 0 || n->exp10 < JSON_POW10_MIN) {
+    *res = n->negative ? -0.0 : 0.0;
     return 1;
+  }
+
+  if (n->exp10 > JSON_POW10_MAX)
+    return 0;
+
+  double d;
+  if (json_eisel_lemire(n->mantissa, n->exp10, n->negative, &d)) {
+    if (!n->truncated) {
+      *res = d;
+      return 1;
+    }
+
+    // the digits that were cut off put the number somewhere between mantissa
+    // and mantissa + 1. If both round the same way, so does the number
+    double up;
+    if (json_eisel_lemire(n->mantissa + 1, n->exp10, n->negative, &up) &&
+        up == d) {
+      *res = d;
+      return 1;
+    }
+  }
+
+  return json_number_slow(s, res);
+}
+
+int json_parse_number(JsonParser_t *parser, TaggedJsonValue_t *value) {
+  if (parser->pos >= parser->index_len)
+    return 0;
+
+  size_t start = parser->index[parser->pos];
+  JsonNumberParts_t parts;
+  size_t end = json_scan_number(parser->src, start, &parts);
+  if (end == start)
+    return 0;
+
+  if (parser->exact_integers &&
+      json_number_to_integer(&parts, &value->el.integer)) {
+    value->type = JSON_INTEGER;
   } else {
+    Str_t number = {.s = parser->src.s + start, .len = end - start};
+    value->type = JSON_NUMBER;
+    if (!json_number_to_double(&parts, number, &value->el.number))
+      return 0;
+  }
+
+  return json_end_scalar(parser, end);
+}
+
+// the 4 bytes at s as a single word, so literals take one comparison
+static uint32_t json_load_word(const char *s) {
+  uint32_t word;
+  memcpy(&word, s, sizeof(word));
+  return word;
+}
+
+// check if the 4 bytes at offset from the current position are word and move
+// past them
+static int json_parse_word(JsonParser_t *parser, size_t offset,
+                           const char *word) {
+  if (parser->pos >= parser->index_len)
+    return 0;
+
+  size_t start = parser->index[parser->pos] + offset;
+  if (parser->src.len - start < 4 ||
+      json_load_word(parser->src.s + start) != json_load_word(word))
+    return 0;
+
+  return json_end_scalar(parser, start + 4);
+}
+
+int json_parse_boolean(JsonParser_t *parser, bool *result) {
+  switch (json_peek(parser)) {
+  case 't':
+    *result = true;
+    return json_parse_word(parser, 0, "true");
+  case 'f':
+    // false is one byte too long for a word, but we already know it starts
+    // with an f
+    *result = false;
+    return json_parse_word(parser, 1, "alse");
+  default:
     return 0;
   }
 }
 
-int json_parse_null(Str_t *s) {
-  *s = ss_trim_left(*s);
-  Str_t null = ss_from_cstring("null");
-  if (!ss_starts_with(*s, null))
+int json_parse_null(JsonParser_t *parser) {
+  return json_peek(parser) == 'n' && json_parse_word(parser, 0, "null");
+}
+
+int json_parse_value(JsonParser_t *parser, TaggedJsonValue_t *value);
+
+// move the values on the stack above mark into an array of their own
+static int json_pop_array(JsonParser_t *parser, size_t mark,
+                          JsonArray_t *result) {
+  size_t len = parser->stack.len - mark;
+  memset(result, 0, sizeof(JsonArray_t));
+  parser->stack.len = mark;
+  if (len == 0)
+    return 1;
+
+  result->buf = (TaggedJsonValue_t *)arena_alloc(
+      parser->arena, len * sizeof(TaggedJsonValue_t));
+  if (!result->buf)
     return 0;
 
-  ss_advance(s, null.len);
+  memcpy(result->buf, parser->stack.buf + mark,
+         len * sizeof(TaggedJsonValue_t));
+  result->cap = len;
+  result->len = len;
   return 1;
 }
 
-int json_parse_value(Str_t *s, TaggedJsonValue_t *value);
+// objects with up to this many keys aren't hashed. Most objects only have a
+// handful of keys, and comparing against all of them is faster than hashing
+#define JSON_SMALL_OBJECT 8
+
+// small objects keep their keys in the order they first appear, in a bucket
+// array that is exactly as long as they are, which is how json_object_get tells
+// them apart. They still have a hash function, so hm_get works on them too: a
+// full table is searched from wherever the key hashes to until it wraps around
+static int json_pop_small_object(JsonParser_t *parser, size_t mark, size_t len,
+                                 JsonObject_t *result) {
+  parser->stack.len = mark;
+  result->hash = json_key_hash;
+  result->eq = json_key_eq;
+  // {} gets a single empty bucket, so hm_get has something to look at
+  if (len == 0) {
+    result->buckets = (KVPair_t(Str_t, TaggedJsonValue_t) *)arena_calloc(
+        parser->arena, 1, sizeof(KVPair_t(Str_t, TaggedJsonValue_t)));
+    result->cap = 1;
+    return result->buckets != NULL;
+  }
 
-int json_parse_array(Str_t *s, JsonArray_t *result) {
-  *s = ss_trim_left(*s);
-  if (s->len == 0 || *s->s != '[')
+  result->buckets = (KVPair_t(Str_t, TaggedJsonValue_t) *)arena_alloc(
+      parser->arena, len * sizeof(KVPair_t(Str_t, TaggedJsonValue_t)));
+  if (!result->buckets)
     return 0;
 
-  if (!da_init(TaggedJsonValue_t)(result, 8))
+  for (size_t i = 0; i < len; i++) {
+    TaggedJsonValue_t *kv = parser->stack.buf + mark + 2 * i;
+    KVPair_t(Str_t, TaggedJsonValue_t) *entry = result->buckets;
+    // interned keys are equal only if they are the same pointer
+    if (parser->keys)
+      while (entry < result->buckets + result->len &&
+             entry->k.s != kv[0].el.string.s)
+        entry++;
+    else
+      while (entry < result->buckets + result->len &&
+             !json_key_eq(&entry->k, &kv[0].el.string))
+        entry++;
+
+    // later keys override earlier ones, just like they do in hashed objects
+    if (entry == result->buckets + result->len)
+      result->len++;
+    entry->occupied = 1;
+    entry->k = kv[0].el.string;
+    entry->v = kv[1];
+    entry->hash = 0;
+  }
+
+  // duplicate keys leave the end of the buckets unused
+  result->cap = result->len;
+  return 1;
+}
+
+// move the key value pairs on the stack above mark into an object of their
+// own
+static int json_pop_object(JsonParser_t *parser, size_t mark,
+                           JsonObject_t *result) {
+  size_t len = (parser->stack.len - mark) / 2;
+  memset(result, 0, sizeof(JsonObject_t));
+  if (len <= JSON_SMALL_OBJECT)
+    return json_pop_small_object(parser, mark, len, result);
+
+  // the map is allocated big enough to never grow, which would try to free the
+  // buckets
+  size_t cap = len + len / 3 + 1;
+  result->buckets = (KVPair_t(Str_t, TaggedJsonValue_t) *)arena_calloc(
+      parser->arena, cap, sizeof(KVPair_t(Str_t, TaggedJsonValue_t)));
+  if (!result->buckets) {
+    parser->stack.len = mark;
     return 0;
+  }
+  result->cap = cap;
+  result->hash = json_key_hash;
+  result->eq = json_key_eq;
+
+  for (size_t i = 0; i < len; i++) {
+    TaggedJsonValue_t *kv = parser->stack.buf + mark + 2 * i;
+    // interned keys were hashed when they were first seen
+    uint64_t hash = parser->keys ? json_key_header(kv[0].el.string)->hash
+                                 : json_key_hash(&kv[0].el.string);
+    KVPair_t(Str_t, TaggedJsonValue_t) *entry =
+        hm_function_call(hm_get_entry_raw, Str_t, TaggedJsonValue_t)(
+            result, &kv[0].el.string, hash);
+    // later keys override earlier ones, just like hm_put does it
+    if (!entry->occupied)
+      result->len++;
+    entry->occupied = 1;
+    entry->k = kv[0].el.string;
+    entry->v = kv[1];
+    entry->hash = hash;
+  }
 
-  ss_advance_once(s);
-  while (s->len > 0) {
-    *s = ss_trim_left(*s);
-    // end of array
-    if (*s->s == ']') {
-      if (!ss_advance_once(s))
-        break;
+  parser->stack.len = mark;
+  return 1;
+}
+
+// hashed objects always have room to spare, small ones never do, except for
+// the spare bucket of {}
+static bool json_object_is_small(const JsonObject_t *object) {
+  return object->cap == object->len || object->len == 0;
+}
+
+// the value of key in object, or NULL if it doesn't have it. Small objects are
+// searched in order, which is faster than hm_get for them
+TaggedJsonValue_t *json_object_get(JsonObject_t *object, Str_t key) {
+  if (!json_object_is_small(object))
+    return hm_get(Str_t, TaggedJsonValue_t)(object, &key);
+
+  for (size_t i = 0; i < object->len; i++)
+    if (json_key_eq(&object->buckets[i].k, &key))
+      return &object->buckets[i].v;
+
+  return NULL;
+}
+
+// json_object_get, for objects in a document parsed with a JsonKeys_t. key has
+// to come from json_keys_intern on the same table, and is compared by pointer
+// instead of by its bytes
+TaggedJsonValue_t *json_object_get_interned(JsonObject_t *object, Str_t key) {
+  if (!json_object_is_small(object)) {
+    KVPair_t(Str_t, TaggedJsonValue_t) *entry =
+        hm_function_call(hm_get_entry_raw, Str_t, TaggedJsonValue_t)(
+            object, &key, json_key_header(key)->hash);
+    return entry && entry->occupied ? &entry->v : NULL;
+  }
+
+  for (size_t i = 0; i < object->len; i++)
+    if (object->buckets[i].k.s == key.s)
+      return &object->buckets[i].v;
+
+  return NULL;
+}
 
+int json_parse_array(JsonParser_t *parser, JsonArray_t *result) {
+  if (json_peek(parser) != '[')
+    return 0;
+
+  size_t mark = parser->stack.len;
+  parser->pos++;
+  for (;;) {
+    // end of array
+    if (json_peek(parser) == ']') {
+      parser->pos++;
       // only successfull case
-      return 1;
+      return json_pop_array(parser, mark, result);
     }
 
     TaggedJsonValue_t new_value;
-    if (!json_parse_value(s, &new_value))
+    if (!json_parse_value(parser, &new_value))
       break;
 
-    if (!da_push(TaggedJsonValue_t)(result, new_value))
+    if (!da_push(TaggedJsonValue_t)(&parser->stack, new_value))
       break;
 
-    *s = ss_trim_left(*s);
-
     // we need to support dangling commas and this code does just that. Notice
     // that this is *NOT* standard JSON
-    if (*s->s == ',') {
+    if (json_peek(parser) == ',') {
       // trash the comma
-      if (!ss_advance_once(s))
-        break;
+      parser->pos++;
       // otherwise, if the next character is not a closing bracket, we have
       // failed
-    } else if (*s->s != ']') {
+    } else if (json_peek(parser) != ']') {
       break;
     }
   }
 
-  da_deinit(TaggedJsonValue_t)(result, json_deinit);
+  // whatever was parsed so far stays in the arena until it's reset
+  parser->stack.len = mark;
   return 0;
 }
 
-int json_parse_object(Str_t *s, JsonObject_t *result) {
-  *s = ss_trim_left(*s);
-  if (s->len == 0 || *s->s != '{')
-    return 0;
-
-  if (!hm_init(String_t, TaggedJsonValue_t)(result, 8, s_hash, s_eq))
+int json_parse_object(JsonParser_t *parser, JsonObject_t *result) {
+  if (json_peek(parser) != '{')
     return 0;
 
-  ss_advance_once(s);
-  while (s->len > 0) {
-    *s = ss_trim_left(*s);
-    // end of array
-    if (*s->s == '}') {
-      ss_advance_once(s);
+  size_t mark = parser->stack.len;
+  parser->pos++;
+  for (;;) {
+    // end of object
+    if (json_peek(parser) == '}') {
+      parser->pos++;
       // only successful case
-      return 1;
+      return json_pop_object(parser, mark, result);
     }
 
-    String_t key;
-    if (!json_parse_string(s, &key))
+    // keys go on the stack as string values, followed by their value
+    TaggedJsonValue_t key = {.type = JSON_STRING};
+    if (!json_parse_string(parser, &key.el.string))
       break;
 
-    *s = ss_trim_left(*s);
-    if (ss_advance_once(s) != ':') {
-      s_deinit(&key);
-      break;
+    if (parser->keys) {
+      key.el.string = json_keys_intern(parser->keys, key.el.string);
+      if (!key.el.string.s)
+        break;
     }
 
-    *s = ss_trim_left(*s);
+    if (json_peek(parser) != ':')
+      break;
+    parser->pos++;
 
     TaggedJsonValue_t new_value;
-    if (!json_parse_value(s, &new_value)) {
-      s_deinit(&key);
+    if (!json_parse_value(parser, &new_value))
       break;
-    }
 
-    if (!hm_put(String_t, TaggedJsonValue_t)(result, key, new_value)) {
-      s_deinit(&key);
+    if (!da_push(TaggedJsonValue_t)(&parser->stack, key) ||
+        !da_push(TaggedJsonValue_t)(&parser->stack, new_value))
       break;
-    }
-
-    *s = ss_trim_left(*s);
 
     // we need to support dangling commas and this code does just that. Notice
     // that this is *NOT* standard JSON
-    if (*s->s == ',') {
+    if (json_peek(parser) == ',') {
       // trash the comma
-      if (!ss_advance_once(s))
-        break;
+      parser->pos++;
       // otherwise, if the next character is not a closing bracket, we have
       // failed
-    } else if (*s->s != '}') {
+    } else if (json_peek(parser) != '}') {
       break;
     }
   }
 
-  hm_deinit(String_t, TaggedJsonValue_t)(result, json_object_kv_deinit);
+  parser->stack.len = mark;
   return 0;
 }
 
-int json_parse_value(Str_t *s, TaggedJsonValue_t *value) {
+// the first byte of a value decides its type, so only one parser ever runs
+int json_parse_value(JsonParser_t *parser, TaggedJsonValue_t *value) {
   memset(value, 0, sizeof(TaggedJsonValue_t));
 
-  *s = ss_trim(*s);
-
-  if (json_parse_string(s, &value->el.string)) {
+  switch (json_peek(parser)) {
+  case '"':
     value->type = JSON_STRING;
-    return 1;
-  } else if (json_parse_number(s, &value->el.number)) {
-    value->type = JSON_NUMBER;
-    return 1;
-  } else if (json_parse_boolean(s, &value->el.boolean)) {
+    return json_parse_string(parser, &value->el.string);
+  case '-':
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+    return json_parse_number(parser, value);
+  case 't':
+  case 'f':
     value->type = JSON_BOOL;
-    return 1;
-  } else if (json_parse_null(s)) {
+    return json_parse_boolean(parser, &value->el.boolean);
+  case 'n':
     value->type = JSON_NULL;
-    return 1;
-  } else if (json_parse_array(s, &value->el.array)) {
+    return json_parse_null(parser);
+  case '[':
     value->type = JSON_ARRAY;
-    return 1;
-  } else if (json_parse_object(s, &value->el.object)) {
+    return json_parse_array(parser, &value->el.array);
+  case '{':
     value->type = JSON_OBJECT;
-    return 1;
-  } else {
+    return json_parse_object(parser, &value->el.object);
+  default:
     return 0;
   }
 }
 
-int json_parse(Str_t s, TaggedJsonValue_t *value) {
-  s = ss_trim(s);
-  if (!json_parse_value(&s, value))
+// the number of values the stack starts out with room for
+#define JSON_STACK_CAP 64
+
+// parse s into doc->root. Strings in doc->root may point into s, so it has to
+// outlive the document, unless the document is given ownership of it through
+// doc->input. Whatever doc held before is freed first, so a single document
+// can be reused for any number of parses
+int json_parse(Str_t s, JsonDocument_t *doc) {
+  json_document_reset(doc);
+
+  JsonParser_t parser;
+  if (!json_index(&parser, s))
     return 0;
 
-  s = ss_trim(s);
-  return s.len == 0;
-}
+  parser.arena = &doc->arena;
+  parser.exact_integers = doc->exact_integers;
+  parser.keys = doc->keys;
+  if (!da_init(TaggedJsonValue_t)(&parser.stack, JSON_STACK_CAP)) {
+    free(parser.index);
+    return 0;
+  }
 
-#ifndef JSON_TESTS
-static int print_usage(const char *prog) {
-  fprintf(stderr, "Usage: %s [--extract <filename> | --bot]\n", prog);
-  return 1;
+  int ok = json_parse_value(&parser, &doc->root);
+  // there must not be anything after the value
+  if (ok && parser.pos != parser.index_len)
+    ok = 0;
+
+  if (!ok)
+    memset(&doc->root, 0, sizeof(TaggedJsonValue_t));
+
+  da_deinit(TaggedJsonValue_t)(&parser.stack, NULL);
+  free(parser.index);
+  return ok;
 }
 
-// parse the content of the file given by filename into value
-// Upon success, the caller is responsible for deiniting value
-static int parse_json_file(const char *filename, TaggedJsonValue_t *value) {
-  FILE *file = fopen(filename, "r");
-  if (!file) {
-    perror("could not open extraction file");
+// A JsonTape_t is a whole document flattened into a single array of 64-bit
+// words, one after the other in the order they appear in the input. It's a lot
+// smaller than a tree of TaggedJsonValue_ts, and walking it is a linear scan.
+// Each word has the JsonType_t of its value in its top 8 bits and a payload
+// in the rest:
+// - arrays and objects point one past the word that ends them, and keep how
+//   many elements they have. The word that ends them has the same type with
+//   JSON_TAPE_CLOSE set, and points back
+// - objects alternate between a key, which is a string, and its value
+// - strings point into a side buffer, where they are stored decoded, after
+//   their length
+// - numbers take 2 words, the second is the double or int64_t itself
+// - booleans are 1 if they are true, null has no payload
+
+#define JSON_TAPE_TYPE_SHIFT 56
+#define JSON_TAPE_PAYLOAD ((1ULL << JSON_TAPE_TYPE_SHIFT) - 1)
+#define JSON_TAPE_CLOSE 0x80
+// containers keep the end in the low 32 bits of the payload and the length in
+// the rest, unless it's too long, in which case the length is counted when
+// asked for
+#define JSON_TAPE_END 0xFFFFFFFFULL
+#define JSON_TAPE_LEN_SHIFT 32
+#define JSON_TAPE_LEN_MAX 0xFFFFFFULL
+
+#define json_tape_word(type, payload)                                         \
+  (((uint64_t)(type) << JSON_TAPE_TYPE_SHIFT) | (payload))
+#define json_tape_type(word) ((unsigned)((word) >> JSON_TAPE_TYPE_SHIFT))
+
+DA_DECLARE_IMPL(uint64_t)
+
+typedef struct {
+  DynamicArray_t(uint64_t) words;
+  // every string, as a 32-bit length followed by its bytes
+  String_t strings;
+  // see JsonDocument_t
+  bool exact_integers;
+} JsonTape_t;
+
+// Upon success, the caller is responsible for deiniting tape
+int json_tape_init(JsonTape_t *tape) {
+  tape->exact_integers = false;
+  if (!da_init(uint64_t)(&tape->words, JSON_STACK_CAP))
     return 0;
-  }
 
-  if (fseek(file, 0, SEEK_END) != 0) {
-    if (fclose(file) != 0)
-      perror("could not close extraction file");
+  if (!s_init(&tape->strings, JSON_STACK_CAP)) {
+    da_deinit(uint64_t)(&tape->words, NULL);
     return 0;
   }
 
-  long file_sz = ftell(file);
-  rewind(file);
+  return 1;
+}
 
-  // one extra for null
-  char *buf = calloc(file_sz + 1, sizeof(char));
-  if (!buf) {
-    if (fclose(file) != 0)
-      perror("could not close extraction file");
+void json_tape_deinit(JsonTape_t *tape) {
+  s_deinit(&tape->strings);
+  da_deinit(uint64_t)(&tape->words, NULL);
+}
 
-    return 0;
-  }
+// the tape is sized up front, so words can be written without checking for
+// room
+static void json_tape_push(JsonTape_t *tape, uint64_t word) {
+  tape->words.buf[tape->words.len++] = word;
+}
 
-  long items_read = fread(buf, file_sz, 1, file);
-  if (items_read != 1) {
-    if (ferror(file))
-      perror("error while reading input file");
-    else if (feof(file))
-      fprintf(stderr,
-              "could not read whole file because eof was encountered\n");
+static int json_tape_value(JsonParser_t *parser, JsonTape_t *tape);
 
-    if (fclose(file) != 0)
-      perror("could not close extraction file");
+static int json_tape_string(JsonParser_t *parser, JsonTape_t *tape) {
+  if (json_peek(parser) != '"')
+    return 0;
 
-    printf("huh?");
-    free(buf);
+  size_t open = parser->index[parser->pos];
+  size_t close = parser->index[parser->pos + 1];
+  Str_t s = {.s = parser->src.s + open + 1, .len = close - open - 1};
+
+  size_t plain = json_plain_prefix(s);
+  if (plain == JSON_CONTROL_CHAR)
+    return 0;
+
+  // decode straight into the side buffer, after the room for the length
+  size_t offset = tape->strings.len;
+  String_t decoded = {.buf = tape->strings.buf + offset + sizeof(uint32_t),
+                      .cap = s.len};
+  if (plain == s.len) {
+    memcpy(decoded.buf, s.s, s.len);
+    decoded.len = s.len;
+  } else if (!json_decode_string(s, plain, &decoded)) {
     return 0;
   }
 
-  if (fclose(file) != 0) {
-    perror("could not close extraction file");
-    free(buf);
+  uint32_t len = (uint32_t)decoded.len;
+  memcpy(tape->strings.buf + offset, &len, sizeof(uint32_t));
+  tape->strings.len += sizeof(uint32_t) + len;
+  json_tape_push(tape, json_tape_word(JSON_STRING, offset));
+  parser->pos += 2;
+  return 1;
+}
+
+// containers are written before their elements and fixed up once the end is
+// found. Objects are arrays too, just with a key before every value
+static int json_tape_container(JsonParser_t *parser, JsonTape_t *tape,
+                               JsonType_t type) {
+  char close = type == JSON_ARRAY ? ']' : '}';
+  size_t start = tape->words.len;
+  json_tape_push(tape, 0);
+  parser->pos++;
+
+  uint64_t len = 0;
+  for (;; len++) {
+    if (json_peek(parser) == close) {
+      parser->pos++;
+      break;
+    }
+
+    if (type == JSON_OBJECT) {
+      if (!json_tape_string(parser, tape) || json_peek(parser) != ':')
+        return 0;
+      parser->pos++;
+    }
+
+    if (!json_tape_value(parser, tape))
+      return 0;
+
+    // trailing commas are allowed here too
+    if (json_peek(parser) == ',')
+      parser->pos++;
+    else if (json_peek(parser) != close)
+      return 0;
+  }
+
+  json_tape_push(tape, json_tape_word(type | JSON_TAPE_CLOSE, start));
+  if (len > JSON_TAPE_LEN_MAX)
+    len = JSON_TAPE_LEN_MAX;
+  tape->words.buf[start] = json_tape_word(
+      type, len << JSON_TAPE_LEN_SHIFT | (uint64_t)tape->words.len);
+  return 1;
+}
+
+static int json_tape_value(JsonParser_t *parser, JsonTape_t *tape) {
+  TaggedJsonValue_t value;
+  switch (json_peek(parser)) {
+  case '"':
+    return json_tape_string(parser, tape);
+  case '-':
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+    if (!json_parse_number(parser, &value))
+      return 0;
+    json_tape_push(tape, json_tape_word(value.type, 0));
+    memcpy(tape->words.buf + tape->words.len++, &value.el, sizeof(uint64_t));
+    return 1;
+  case 't':
+  case 'f':
+    if (!json_parse_boolean(parser, &value.el.boolean))
+      return 0;
+    json_tape_push(tape, json_tape_word(JSON_BOOL, value.el.boolean));
+    return 1;
+  case 'n':
+    if (!json_parse_null(parser))
+      return 0;
+    json_tape_push(tape, json_tape_word(JSON_NULL, 0));
+    return 1;
+  case '[':
+    return json_tape_container(parser, tape, JSON_ARRAY);
+  case '{':
+    return json_tape_container(parser, tape, JSON_OBJECT);
+  default:
     return 0;
   }
+}
 
-  Str_t json_data = ss_from_cstring(buf);
+// parse s into tape. Unlike a JsonDocument_t, nothing on the tape points into
+// s, so it can go away right after. Whatever tape held before is dropped,
+// keeping its memory around for the next parse
+int json_tape_parse(Str_t s, JsonTape_t *tape) {
+  tape->words.len = 0;
+  tape->strings.len = 0;
 
-  if (!json_parse(json_data, value)) {
-    fprintf(stderr, "Not an accepted JSON!\n");
-    free(buf);
+  JsonParser_t parser;
+  if (!json_index(&parser, s))
     return 0;
+  parser.exact_integers = tape->exact_integers;
+
+  // every entry of the index is at most one word, except for numbers, which
+  // are two. Strings take two entries, their quotes, and need at most 2 bytes
+  // for each in the side buffer, along with their contents
+  size_t words = 2 * parser.index_len + 1;
+  size_t strings = s.len + 2 * parser.index_len;
+  // containers can only point as far as 32 bits go
+  int ok = words <= JSON_TAPE_END &&
+           (words <= tape->words.cap ||
+            da_function_call(da_grow, uint64_t)(&tape->words, words)) &&
+           (strings <= tape->strings.cap ||
+            da_function_call(da_grow, char)(&tape->strings, strings)) &&
+           json_tape_value(&parser, tape) && parser.pos == parser.index_len;
+
+  if (!ok) {
+    tape->words.len = 0;
+    tape->strings.len = 0;
+  }
+
+  free(parser.index);
+  return ok;
+}
+
+// A JsonCursor_t points at a value on a tape. Cursors are only valid until the
+// tape is parsed into again
+typedef struct {
+  const JsonTape_t *tape;
+  // the index of the first word of the value
+  size_t pos;
+} JsonCursor_t;
+
+JsonCursor_t json_tape_root(const JsonTape_t *tape) {
+  return (JsonCursor_t){.tape = tape, .pos = 0};
+}
+
+static uint64_t json_cursor_word(JsonCursor_t c) {
+  return c.tape->words.buf[c.pos];
+}
+
+JsonType_t json_cursor_type(JsonCursor_t c) {
+  return (JsonType_t)json_tape_type(json_cursor_word(c));
+}
+
+// c has to be a string
+Str_t json_cursor_string(JsonCursor_t c) {
+  const char *s =
+      c.tape->strings.buf + (json_cursor_word(c) & JSON_TAPE_PAYLOAD);
+  uint32_t len;
+  memcpy(&len, s, sizeof(uint32_t));
+  return (Str_t){.s = s + sizeof(uint32_t), .len = len};
+}
+
+// c has to be a number. Integers are converted
+double json_cursor_number(JsonCursor_t c) {
+  uint64_t bits = c.tape->words.buf[c.pos + 1];
+  if (json_cursor_type(c) == JSON_INTEGER) {
+    int64_t integer;
+    memcpy(&integer, &bits, sizeof(int64_t));
+    return (double)integer;
+  }
+
+  double number;
+  memcpy(&number, &bits, sizeof(double));
+  return number;
+}
+
+// c has to be an integer
+int64_t json_cursor_integer(JsonCursor_t c) {
+  int64_t integer;
+  memcpy(&integer, c.tape->words.buf + c.pos + 1, sizeof(int64_t));
+  return integer;
+}
+
+// c has to be a boolean
+bool json_cursor_boolean(JsonCursor_t c) {
+  return json_cursor_word(c) & 1;
+}
+
+// the index of the word after the value at c
+static size_t json_cursor_end(JsonCursor_t c) {
+  uint64_t word = json_cursor_word(c);
+  switch (json_tape_type(word)) {
+  case JSON_ARRAY:
+  case JSON_OBJECT:
+    return word & JSON_TAPE_END;
+  case JSON_NUMBER:
+  case JSON_INTEGER:
+    return c.pos + 2;
+  default:
+    return c.pos + 1;
   }
+}
 
-  // this also nukes the json_data buffer
-  free(buf);
-  (void)json_data;
+// move c to the value after it in the same container. Fails at the end of the
+// container, or of the tape. Keys count as values, so in an object this goes
+// from a key to its value and from the value to the next key
+int json_cursor_next(JsonCursor_t *c) {
+  size_t next = json_cursor_end(*c);
+  if (next >= c->tape->words.len)
+    return 0;
+
+  if (json_tape_type(c->tape->words.buf[next]) & JSON_TAPE_CLOSE)
+    return 0;
+
+  c->pos = next;
   return 1;
 }
 
-// this returns into res_s a pointer tied to the value owned by json. Therefore,
-// if json is deinit'ed the res_s string slice is invalid
-static int extract_content_field(TaggedJsonValue_t *json, Str_t *res_s) {
-  // top level value must be an object
-  if (json->type != JSON_OBJECT)
+// the first element of the array, or the first key of the object at c. Fails
+// if it's empty
+int json_cursor_child(JsonCursor_t c, JsonCursor_t *child) {
+  if (json_tape_type(c.tape->words.buf[c.pos + 1]) & JSON_TAPE_CLOSE)
     return 0;
 
-  String_t key;
-  if (!s_init(&key, 10))
+  *child = (JsonCursor_t){.tape = c.tape, .pos = c.pos + 1};
+  return 1;
+}
+
+// the number of elements in the array, or keys in the object at c
+size_t json_cursor_len(JsonCursor_t c) {
+  size_t len = json_cursor_word(c) >> JSON_TAPE_LEN_SHIFT & JSON_TAPE_LEN_MAX;
+  if (len < JSON_TAPE_LEN_MAX)
+    return len;
+
+  // too long to fit, count them
+  JsonCursor_t child;
+  len = 0;
+  if (json_cursor_child(c, &child))
+    for (len = 1; json_cursor_next(&child); len++)
+      ;
+  return json_cursor_type(c) == JSON_OBJECT ? len / 2 : len;
+}
+
+// the element at idx in the array at c
+int json_cursor_index(JsonCursor_t c, size_t idx, JsonCursor_t *el) {
+  if (json_cursor_type(c) != JSON_ARRAY || !json_cursor_child(c, el))
     return 0;
 
-  if (!s_push_cstr(&key, "choices")) {
-    s_deinit(&key);
+  for (size_t i = 0; i < idx; i++)
+    if (!json_cursor_next(el))
+      return 0;
+
+  return 1;
+}
+
+// the value of key in the object at c. Like json_parse, if a key appears more
+// than once, the last one wins
+int json_cursor_get(JsonCursor_t c, Str_t key, JsonCursor_t *value) {
+  JsonCursor_t k;
+  if (json_cursor_type(c) != JSON_OBJECT || !json_cursor_child(c, &k))
     return 0;
+
+  int found = 0;
+  do {
+    JsonCursor_t v = k;
+    json_cursor_next(&v);
+    if (ss_eq(json_cursor_string(k), key)) {
+      *value = v;
+      found = 1;
+    }
+    k = v;
+  } while (json_cursor_next(&k));
+
+  return found;
+}
+
+// Paths pick a single value out of a document, like
+// choices[0].message.content. Extracting one doesn't build the rest of the
+// document: everything on the way to the value is skipped by matching brackets
+// and quotes, without an index and without allocating anything
+
+// the most steps a path can have
+#define JSON_PATH_MAX 16
+
+typedef struct {
+  // set if this step indexes into an array, otherwise it looks up key in an
+  // object
+  bool is_index;
+  size_t index;
+  Str_t key;
+} JsonPathStep_t;
+
+typedef struct {
+  JsonPathStep_t steps[JSON_PATH_MAX];
+  size_t len;
+} JsonPath_t;
+
+// compile src, a list of keys separated by dots and [indices], into path. An
+// empty path is the whole document. Keys point into src, so it has to outlive
+// path
+int json_path_compile(const char *src, JsonPath_t *path) {
+  memset(path, 0, sizeof(JsonPath_t));
+  Str_t s = ss_from_cstring(src);
+  while (s.len > 0) {
+    if (path->len == JSON_PATH_MAX)
+      return 0;
+
+    JsonPathStep_t *step = path->steps + path->len;
+    if (s.s[0] == '[') {
+      ss_advance_once(&s);
+      step->is_index = true;
+      size_t digits = 0;
+      for (; s.len > 0 && isdigit((uint8_t)s.s[0]); digits++) {
+        if (step->index > (SIZE_MAX - 9) / 10)
+          return 0;
+        step->index = step->index * 10 + (ss_advance_once(&s) - '0');
+      }
+
+      if (digits == 0 || ss_advance_once(&s) != ']')
+        return 0;
+    } else {
+      // every key but the first one comes after a dot
+      if (path->len > 0 && ss_advance_once(&s) != '.')
+        return 0;
+
+      size_t len = 0;
+      while (len < s.len && s.s[len] != '.' && s.s[len] != '[')
+        len++;
+      if (len == 0)
+        return 0;
+
+      step->key = ss_advance(&s, len);
+    }
+
+    path->len++;
+  }
+
+  return 1;
+}
+
+typedef struct {
+  Str_t src;
+  size_t pos;
+} JsonScanner_t;
+
+// the byte at the current position, 0 if there is none
+static char json_scan_peek(JsonScanner_t *sc) {
+  return sc->pos < sc->src.len ? sc->src.s[sc->pos] : '\0';
+}
+
+static void json_scan_ws(JsonScanner_t *sc) {
+  while (sc->pos < sc->src.len &&
+         (json_char_class[(uint8_t)sc->src.s[sc->pos]] & JSON_CLASS_WHITESPACE))
+    sc->pos++;
+}
+
+// move past the string that starts at the current position
+static int json_skip_string(JsonScanner_t *sc) {
+  size_t start = sc->pos + 1;
+  size_t i = start;
+  for (;;) {
+    const char *quote = memchr(sc->src.s + i, '"', sc->src.len - i);
+    if (!quote)
+      return 0;
+
+    // a quote is escaped if an odd number of backslashes come before it
+    size_t end = quote - sc->src.s;
+    size_t backslashes = 0;
+    while (end - backslashes > start &&
+           sc->src.s[end - backslashes - 1] == '\\')
+      backslashes++;
+
+    i = end + 1;
+    if (backslashes % 2 == 0) {
+      sc->pos = i;
+      return 1;
+    }
+  }
+}
+
+// move past the value that starts at the current position. Only strings and
+// the nesting of containers are checked, the rest is left to json_parse
+static int json_skip_value(JsonScanner_t *sc) {
+  char c = json_scan_peek(sc);
+  if (c == '"')
+    return json_skip_string(sc);
+
+  if (c != '{' && c != '[') {
+    // scalars end at the next whitespace or structural character
+    size_t start = sc->pos;
+    while (sc->pos < sc->src.len &&
+           !(json_char_class[(uint8_t)sc->src.s[sc->pos]] &
+             (JSON_CLASS_WHITESPACE | JSON_CLASS_OP | JSON_CLASS_QUOTE)))
+      sc->pos++;
+    return sc->pos != start;
   }
 
-  // that contains a choices array
-  TaggedJsonValue_t *choices =
-      hm_get(String_t, TaggedJsonValue_t)(&json->el.object, &key);
-  if (!choices || choices->type != JSON_ARRAY) {
-    s_deinit(&key);
+  size_t depth = 0;
+  while (sc->pos < sc->src.len) {
+    c = sc->src.s[sc->pos];
+    if (!(json_char_class[(uint8_t)c] & (JSON_CLASS_OP | JSON_CLASS_QUOTE))) {
+      sc->pos++;
+      continue;
+    }
+
+    if (c == '"') {
+      if (!json_skip_string(sc))
+        return 0;
+      continue;
+    }
+
+    sc->pos++;
+    if (c == '{' || c == '[')
+      depth++;
+    else if ((c == '}' || c == ']') && --depth == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+// check if the contents of a key, raw, are key once decoded
+static int json_key_matches(Str_t raw, Str_t key, int *match) {
+  size_t plain = json_plain_prefix(raw);
+  if (plain == JSON_CONTROL_CHAR)
     return 0;
+
+  if (plain == raw.len) {
+    *match = ss_eq(raw, key);
+    return 1;
   }
 
-  // with at least one element
-  TaggedJsonValue_t *choices_0 =
-      da_get(TaggedJsonValue_t)(&choices->el.array, 0);
+  // keys with escape sequences in them are rare enough to just decode them
+  String_t decoded;
+  if (!s_init(&decoded, raw.len + 1))
+    return 0;
 
-  s_clear(&key);
-  // which in turn contains a message object
-  if (!choices_0 || !s_push_cstr(&key, "message")) {
-    s_deinit(&key);
+  if (!json_decode_string(raw, plain, &decoded)) {
+    s_deinit(&decoded);
     return 0;
   }
 
-  TaggedJsonValue_t *message =
-      hm_get(String_t, TaggedJsonValue_t)(&choices_0->el.object, &key);
+  *match = ss_eq(s_str(&decoded), key);
+  s_deinit(&decoded);
+  return 1;
+}
 
-  s_clear(&key);
-  // which finally has a content string in it
-  if (!message || !s_push_cstr(&key, "content")) {
-    s_deinit(&key);
+// move to the value of key in the object at the current position. Like
+// json_parse, if key appears more than once the last one wins, so the whole
+// object is scanned
+static int json_scan_member(JsonScanner_t *sc, Str_t key) {
+  if (json_scan_peek(sc) != '{')
     return 0;
+
+  // where the value of the last key that matched starts, 0 if none did
+  size_t found = 0;
+  sc->pos++;
+  for (;;) {
+    json_scan_ws(sc);
+    if (json_scan_peek(sc) == '}' && found) {
+      sc->pos = found;
+      return 1;
+    }
+
+    if (json_scan_peek(sc) != '"')
+      // this also covers the end of the object, where key wasn't found
+      return 0;
+
+    size_t key_start = sc->pos + 1;
+    if (!json_skip_string(sc))
+      return 0;
+
+    Str_t raw = {.s = sc->src.s + key_start, .len = sc->pos - 1 - key_start};
+    int match;
+    if (!json_key_matches(raw, key, &match))
+      return 0;
+
+    json_scan_ws(sc);
+    if (json_scan_peek(sc) != ':')
+      return 0;
+    sc->pos++;
+    json_scan_ws(sc);
+
+    if (match)
+      found = sc->pos;
+
+    if (!json_skip_value(sc))
+      return 0;
+
+    // trailing commas are fine here too
+    json_scan_ws(sc);
+    if (json_scan_peek(sc) == ',')
+      sc->pos++;
+    else if (json_scan_peek(sc) != '}')
+      return 0;
   }
+}
 
-  TaggedJsonValue_t *content =
-      hm_get(String_t, TaggedJsonValue_t)(&message->el.object, &key);
-  if (!content || content->type != JSON_STRING) {
-    s_deinit(&key);
+// move to element index of the array at the current position
+static int json_scan_element(JsonScanner_t *sc, size_t index) {
+  if (json_scan_peek(sc) != '[')
     return 0;
+
+  sc->pos++;
+  for (size_t i = 0;; i++) {
+    json_scan_ws(sc);
+    if (json_scan_peek(sc) == ']')
+      return 0;
+
+    if (i == index)
+      return 1;
+
+    if (!json_skip_value(sc))
+      return 0;
+
+    json_scan_ws(sc);
+    if (json_scan_peek(sc) != ',')
+      return 0;
+    sc->pos++;
+  }
+}
+
+// parse only the value path points to in s into doc->root. Fails if the value
+// isn't there, or is invalid. Like with json_parse, strings in doc->root may
+// point into s
+int json_extract(Str_t s, const JsonPath_t *path, JsonDocument_t *doc) {
+  if (path->len == 0)
+    return json_parse(s, doc);
+
+  json_document_reset(doc);
+  JsonScanner_t sc = {.src = s};
+  for (size_t i = 0; i < path->len; i++) {
+    const JsonPathStep_t *step = path->steps + i;
+    json_scan_ws(&sc);
+    if (step->is_index ? !json_scan_element(&sc, step->index)
+                       : !json_scan_member(&sc, step->key))
+      return 0;
   }
 
-  s_deinit(&key);
+  json_scan_ws(&sc);
+  size_t start = sc.pos;
+  if (!json_skip_value(&sc))
+    return 0;
+
+  Str_t value = {.s = s.s + start, .len = sc.pos - start};
+  return json_parse(value, doc);
+}
 
-  // the lifetime of res_s is tied to content and since content is part of the
-  // json res_s is actually tied to the json
-  *res_s = s_str(&content->el.string);
+// The streaming parser takes a document in chunks of any size, as they
+// arrive, and reports what it finds through callbacks instead of building
+// values. It only keeps the open containers and whatever part of a string or
+// scalar was cut off at the end of the previous chunk, so documents of any
+// size can be parsed with about as much memory as their biggest string
+
+// Strings handed to callbacks are only valid during the call. Any callback can
+// be NULL, and returning 0 from one stops the parser
+typedef struct {
+  int (*start_object)(void *ctx);
+  int (*end_object)(void *ctx);
+  int (*start_array)(void *ctx);
+  int (*end_array)(void *ctx);
+  int (*key)(void *ctx, Str_t key);
+  int (*string)(void *ctx, Str_t s);
+  int (*number)(void *ctx, double n);
+  // if this is set, integers that fit in an int64_t are reported through it
+  // exactly, instead of through number
+  int (*integer)(void *ctx, int64_t n);
+  int (*boolean)(void *ctx, bool b);
+  int (*null)(void *ctx);
+} JsonStreamCallbacks_t;
+
+typedef enum {
+  // a value has to come next
+  JSON_STREAM_VALUE,
+  // a value or the end of the array
+  JSON_STREAM_ELEMENT,
+  // a key or the end of the object
+  JSON_STREAM_MEMBER,
+  JSON_STREAM_COLON,
+  // a comma or the end of the container after one of its values
+  JSON_STREAM_NEXT,
+  JSON_STREAM_STRING,
+  // numbers, true, false and null
+  JSON_STREAM_SCALAR,
+  // the whole document has been parsed, only whitespace can follow
+  JSON_STREAM_DONE,
+  // either the document was invalid or a callback stopped the parser
+  JSON_STREAM_STOPPED,
+} JsonStreamState_t;
+
+typedef struct {
+  const JsonStreamCallbacks_t *cb;
+  void *ctx;
+  JsonStreamState_t state;
+  // the opening bracket of every container that is open
+  String_t stack;
+  // the part of the current string or scalar that was in earlier chunks
+  String_t token;
+  // strings with escape sequences are decoded into this
+  String_t decoded;
+  // set if the current string is a key
+  bool in_key;
+  // set if the last byte of the previous chunk was an unescaped backslash
+  bool escaped;
+} JsonStream_t;
+
+// Upon success, the caller is responsible for deiniting js
+int json_stream_init(JsonStream_t *js, const JsonStreamCallbacks_t *cb,
+                     void *ctx) {
+  memset(js, 0, sizeof(JsonStream_t));
+  js->cb = cb;
+  js->ctx = ctx;
+  if (!s_init(&js->stack, 16))
+    return 0;
+
+  if (!s_init(&js->token, 64)) {
+    s_deinit(&js->stack);
+    return 0;
+  }
+
+  if (!s_init(&js->decoded, 64)) {
+    s_deinit(&js->token);
+    s_deinit(&js->stack);
+    return 0;
+  }
 
   return 1;
 }
 
+void json_stream_deinit(JsonStream_t *js) {
+  s_deinit(&js->decoded);
+  s_deinit(&js->token);
+  s_deinit(&js->stack);
+}
+
+// call a callback that is allowed to be NULL with the given arguments, which
+// start with the ctx
+#define json_stream_emit(js, name, ...)                                        \
+  (!(js)->cb->name || (js)->cb->name(__VA_ARGS__))
+
+// a value just ended, figure out what comes next
+static void json_stream_value_done(JsonStream_t *js) {
+  js->state = js->stack.len == 0 ? JSON_STREAM_DONE : JSON_STREAM_NEXT;
+}
+
+static int json_stream_open(JsonStream_t *js, char bracket) {
+  if (!s_push(&js->stack, bracket))
+    return 0;
+
+  if (bracket == '{') {
+    js->state = JSON_STREAM_MEMBER;
+    return json_stream_emit(js, start_object, js->ctx);
+  } else {
+    js->state = JSON_STREAM_ELEMENT;
+    return json_stream_emit(js, start_array, js->ctx);
+  }
+}
+
+static int json_stream_close(JsonStream_t *js, char bracket) {
+  char open = bracket == '}' ? '{' : '[';
+  if (js->stack.len == 0 || js->stack.buf[js->stack.len - 1] != open)
+    return 0;
+
+  js->stack.len--;
+  json_stream_value_done(js);
+  if (open == '{')
+    return json_stream_emit(js, end_object, js->ctx);
+  else
+    return json_stream_emit(js, end_array, js->ctx);
+}
+
+// report the string with contents raw
+static int json_stream_string(JsonStream_t *js, Str_t raw) {
+  size_t plain = json_plain_prefix(raw);
+  if (plain == JSON_CONTROL_CHAR)
+    return 0;
+
+  Str_t s = raw;
+  if (plain != raw.len) {
+    // make sure json_decode_string has room for all of raw
+    if (js->decoded.cap < raw.len &&
+        !da_function_call(da_grow, char)(&js->decoded, raw.len))
+      return 0;
+
+    if (!json_decode_string(raw, plain, &js->decoded))
+      return 0;
+    s = s_str(&js->decoded);
+  }
+
+  if (js->in_key) {
+    js->state = JSON_STREAM_COLON;
+    return json_stream_emit(js, key, js->ctx, s);
+  }
+
+  json_stream_value_done(js);
+  return json_stream_emit(js, string, js->ctx, s);
+}
+
+// report the number or literal s
+static int json_stream_scalar(JsonStream_t *js, Str_t s) {
+  json_stream_value_done(js);
+  if (ss_eq(s, ss_from_cstring("true")))
+    return json_stream_emit(js, boolean, js->ctx, true);
+  if (ss_eq(s, ss_from_cstring("false")))
+    return json_stream_emit(js, boolean, js->ctx, false);
+  if (ss_eq(s, ss_from_cstring("null")))
+    return json_stream_emit(js, null, js->ctx);
+
+  JsonNumberParts_t parts;
+  if (s.len == 0 || json_scan_number(s, 0, &parts) != s.len)
+    return 0;
+
+  int64_t integer;
+  if (js->cb->integer && json_number_to_integer(&parts, &integer))
+    return js->cb->integer(js->ctx, integer);
+
+  double n;
+  if (!json_number_to_double(&parts, s, &n))
+    return 0;
+  return json_stream_emit(js, number, js->ctx, n);
+}
+
+// the current token is done and its last part is tail. If nothing of it was in
+// earlier chunks, tail is all of it and doesn't need to be copied
+static int json_stream_token(JsonStream_t *js, Str_t tail, Str_t *res) {
+  if (js->token.len == 0) {
+    *res = tail;
+    return 1;
+  }
+
+  if (!s_push_str(&js->token, tail))
+    return 0;
+  *res = s_str(&js->token);
+  return 1;
+}
+
+// continue the string in chunk at *i
+static int json_stream_feed_string(JsonStream_t *js, Str_t chunk, size_t *i) {
+  size_t start = *i;
+  size_t pos = start;
+  for (;;) {
+    if (js->escaped) {
+      // whatever follows a backslash doesn't end the string
+      if (pos == chunk.len)
+        break;
+      js->escaped = false;
+      pos++;
+    }
+
+    while (pos < chunk.len &&
+           !(json_char_class[(uint8_t)chunk.s[pos]] &
+             (JSON_CLASS_QUOTE | JSON_CLASS_BACKSLASH)))
+      pos++;
+    if (pos == chunk.len)
+      break;
+
+    if (chunk.s[pos] == '\\') {
+      js->escaped = true;
+      pos++;
+      continue;
+    }
+
+    // the closing quote
+    Str_t tail = {.s = chunk.s + start, .len = pos - start}, raw;
+    *i = pos + 1;
+    if (!json_stream_token(js, tail, &raw))
+      return 0;
+    int ok = json_stream_string(js, raw);
+    s_clear(&js->token);
+    return ok;
+  }
+
+  // the string goes on in the next chunk
+  Str_t part = {.s = chunk.s + start, .len = pos - start};
+  *i = pos;
+  return s_push_str(&js->token, part);
+}
+
+// continue the scalar in chunk at *i
+static int json_stream_feed_scalar(JsonStream_t *js, Str_t chunk, size_t *i) {
+  size_t start = *i;
+  size_t pos = start;
+  while (pos < chunk.len &&
+         !(json_char_class[(uint8_t)chunk.s[pos]] &
+           (JSON_CLASS_WHITESPACE | JSON_CLASS_OP | JSON_CLASS_QUOTE)))
+    pos++;
+
+  Str_t tail = {.s = chunk.s + start, .len = pos - start};
+  *i = pos;
+  // the scalar might go on in the next chunk
+  if (pos == chunk.len)
+    return s_push_str(&js->token, tail);
+
+  Str_t scalar;
+  if (!json_stream_token(js, tail, &scalar))
+    return 0;
+  int ok = json_stream_scalar(js, scalar);
+  s_clear(&js->token);
+  return ok;
+}
+
+// handle the byte c that isn't part of a string or scalar
+static int json_stream_structural(JsonStream_t *js, char c) {
+  switch (js->state) {
+  case JSON_STREAM_ELEMENT:
+    if (c == ']')
+      return json_stream_close(js, c);
+    // fall through
+  case JSON_STREAM_VALUE:
+    if (c == '{' || c == '[')
+      return json_stream_open(js, c);
+    if (c == '"') {
+      js->in_key = false;
+      js->state = JSON_STREAM_STRING;
+      return 1;
+    }
+    if (json_char_class[(uint8_t)c] & JSON_CLASS_OP)
+      return 0;
+    js->state = JSON_STREAM_SCALAR;
+    return 1;
+  case JSON_STREAM_MEMBER:
+    if (c == '}')
+      return json_stream_close(js, c);
+    if (c != '"')
+      return 0;
+    js->in_key = true;
+    js->state = JSON_STREAM_STRING;
+    return 1;
+  case JSON_STREAM_COLON:
+    if (c != ':')
+      return 0;
+    js->state = JSON_STREAM_VALUE;
+    return 1;
+  case JSON_STREAM_NEXT:
+    // we need to support dangling commas, just like json_parse
+    if (c == ',') {
+      js->state = js->stack.buf[js->stack.len - 1] == '{' ? JSON_STREAM_MEMBER
+                                                         : JSON_STREAM_ELEMENT;
+      return 1;
+    }
+    if (c == '}' || c == ']')
+      return json_stream_close(js, c);
+    return 0;
+  default:
+    // nothing but whitespace after the document
+    return 0;
+  }
+}
+
+// parse the next chunk of the document. Returns 0 if the document is invalid
+// or a callback stopped the parser, after which it doesn't accept any more
+// chunks
+int json_stream_feed(JsonStream_t *js, Str_t chunk) {
+  size_t i = 0;
+  while (i < chunk.len && js->state != JSON_STREAM_STOPPED) {
+    int ok;
+    if (js->state == JSON_STREAM_STRING) {
+      ok = json_stream_feed_string(js, chunk, &i);
+    } else if (js->state == JSON_STREAM_SCALAR) {
+      ok = json_stream_feed_scalar(js, chunk, &i);
+    } else if (json_char_class[(uint8_t)chunk.s[i]] & JSON_CLASS_WHITESPACE) {
+      i++;
+      continue;
+    } else {
+      // scalars start on the byte that got us into JSON_STREAM_SCALAR, the
+      // rest are consumed here
+      ok = json_stream_structural(js, chunk.s[i]);
+      if (js->state != JSON_STREAM_SCALAR)
+        i++;
+    }
+
+    if (!ok)
+      js->state = JSON_STREAM_STOPPED;
+  }
+
+  return js->state != JSON_STREAM_STOPPED;
+}
+
+// tell the parser there are no more chunks. Fails unless they made up exactly
+// one value
+int json_stream_finish(JsonStream_t *js) {
+  if (js->state == JSON_STREAM_SCALAR) {
+    // the end of the document is the only thing that ended this scalar
+    int ok = json_stream_scalar(js, s_str(&js->token));
+    s_clear(&js->token);
+    if (!ok)
+      js->state = JSON_STREAM_STOPPED;
+  }
+
+  return js->state == JSON_STREAM_DONE;
+}
+
+// A JsonStreamPath_t picks the string at path out of a stream, without keeping
+// anything else around. Like json_parse, if a key appears more than once the
+// last one wins, so a later duplicate can replace the string, or take it away.
+// The stream is stopped once the document ends, and only then is the string
+// known to be the right one. Anything after the end isn't looked at
+typedef struct {
+  const JsonPath_t *path;
+  // the string is copied into this once it's found
+  String_t *result;
+  bool found;
+  // the document ended, so found is final. If the stream stopped without
+  // this being set, the document was cut off or invalid
+  bool done;
+  // the number of containers that are open, and how many of them are on the
+  // path
+  size_t depth;
+  size_t matched;
+  // the innermost container on the path is an array, and this is the index of
+  // its next element
+  bool in_array;
+  size_t element;
+  // or it's an object, and its last key is the next step of the path
+  bool key_matches;
+} JsonStreamPath_t;
+
+// check if the value that starts now is on the path
+static bool json_stream_path_value(JsonStreamPath_t *sp) {
+  if (sp->depth == 0)
+    return true;
+
+  if (sp->depth != sp->matched || sp->depth > sp->path->len)
+    return false;
+
+  const JsonPathStep_t *step = sp->path->steps + sp->depth - 1;
+  bool on_path = step->is_index == sp->in_array &&
+                 (step->is_index ? sp->element == step->index
+                                 : sp->key_matches);
+  sp->element++;
+  sp->key_matches = false;
+  // this value replaces the one the string was found in, if there was one
+  if (on_path)
+    sp->found = false;
+  return on_path;
+}
+
+static int json_stream_path_open(JsonStreamPath_t *sp, bool array) {
+  bool on_path = json_stream_path_value(sp);
+  sp->depth++;
+  // the path can't end in a container
+  if (on_path && sp->depth <= sp->path->len) {
+    sp->matched = sp->depth;
+    sp->in_array = array;
+    sp->element = 0;
+    sp->key_matches = false;
+  }
+
+  return 1;
+}
+
+static int json_stream_path_start_object(void *ctx) {
+  return json_stream_path_open((JsonStreamPath_t *)ctx, false);
+}
+
+static int json_stream_path_start_array(void *ctx) {
+  return json_stream_path_open((JsonStreamPath_t *)ctx, true);
+}
+
+static int json_stream_path_end(void *ctx) {
+  JsonStreamPath_t *sp = (JsonStreamPath_t *)ctx;
+  if (sp->depth == sp->matched) {
+    // back in the container the one that ended is in, which is on the path
+    // too, so its kind and where it was are known from the step it took
+    sp->matched--;
+    if (sp->matched > 0) {
+      const JsonPathStep_t *step = sp->path->steps + sp->matched - 1;
+      sp->in_array = step->is_index;
+      sp->element = step->index + 1;
+      sp->key_matches = false;
+    }
+  }
+
+  sp->depth--;
+  // the document is done, there is nothing left that could change the result
+  sp->done = sp->depth == 0;
+  return !sp->done;
+}
+
+static int json_stream_path_key(void *ctx, Str_t key) {
+  JsonStreamPath_t *sp = (JsonStreamPath_t *)ctx;
+  if (sp->depth == sp->matched && sp->depth <= sp->path->len && !sp->in_array)
+    sp->key_matches = ss_eq(key, sp->path->steps[sp->depth - 1].key);
+  return 1;
+}
+
+static int json_stream_path_string(void *ctx, Str_t s) {
+  JsonStreamPath_t *sp = (JsonStreamPath_t *)ctx;
+  if (!json_stream_path_value(sp))
+    return 1;
+
+  // a root string is the whole document
+  sp->done = sp->depth == 0;
+  // the path can't go through a string
+  if (sp->depth != sp->path->len)
+    return !sp->done;
+
+  s_clear(sp->result);
+  sp->found = s_push_str(sp->result, s);
+  return sp->found && !sp->done;
+}
+
+// numbers, booleans and nulls
+static int json_stream_path_scalar(JsonStreamPath_t *sp) {
+  // the path can't go through these and doesn't end at a string if it ends
+  // here, but a later duplicate could still be a string
+  json_stream_path_value(sp);
+  sp->done = sp->depth == 0;
+  return !sp->done;
+}
+
+static int json_stream_path_number(void *ctx, double n) {
+  (void)n;
+  return json_stream_path_scalar((JsonStreamPath_t *)ctx);
+}
+
+static int json_stream_path_boolean(void *ctx, bool b) {
+  (void)b;
+  return json_stream_path_scalar((JsonStreamPath_t *)ctx);
+}
+
+static int json_stream_path_null(void *ctx) {
+  return json_stream_path_scalar((JsonStreamPath_t *)ctx);
+}
+
+const JsonStreamCallbacks_t json_stream_path_callbacks = {
+    .start_object = json_stream_path_start_object,
+    .end_object = json_stream_path_end,
+    .start_array = json_stream_path_start_array,
+    .end_array = json_stream_path_end,
+    .key = json_stream_path_key,
+    .string = json_stream_path_string,
+    .number = json_stream_path_number,
+    .boolean = json_stream_path_boolean,
+    .null = json_stream_path_null,
+};
+
+#ifndef JSON_TESTS
+static int print_usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--extract <filename> | --bot]\n", prog);
+  return 1;
+}
+
+// where the reply is in a chat completion
+#define CONTENT_PATH "choices[0].message.content"
+
+// parse the value at path in the file given by filename into doc
+// Upon success, the caller is responsible for deiniting doc
+static int parse_json_file(const char *filename, const JsonPath_t *path,
+                           JsonDocument_t *doc) {
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    perror("could not open extraction file");
+    return 0;
+  }
+
+  if (fseek(file, 0, SEEK_END) != 0) {
+    if (fclose(file) != 0)
+      perror("could not close extraction file");
+    return 0;
+  }
+
+  long file_sz = ftell(file);
+  rewind(file);
+
+  // nothing needs the input to be null terminated, so it's read as is
+  char *buf = malloc(file_sz);
+  if (!buf) {
+    if (fclose(file) != 0)
+      perror("could not close extraction file");
+
+    return 0;
+  }
+
+  long items_read = fread(buf, file_sz, 1, file);
+  if (items_read != 1) {
+    if (ferror(file))
+      perror("error while reading input file");
+    else if (feof(file))
+      fprintf(stderr,
+              "could not read whole file because eof was encountered\n");
+
+    if (fclose(file) != 0)
+      perror("could not close extraction file");
+
+    printf("huh?");
+    free(buf);
+    return 0;
+  }
+
+  if (fclose(file) != 0) {
+    perror("could not close extraction file");
+    free(buf);
+    return 0;
+  }
+
+  Str_t json_data = {.s = buf, .len = (size_t)file_sz};
+
+  if (!json_document_init(doc)) {
+    perror("could not allocate json document");
+    free(buf);
+    return 0;
+  }
+
+  if (!json_extract(json_data, path, doc)) {
+    fprintf(stderr, "Not an accepted JSON, or it is missing the value!\n");
+    json_document_deinit(doc);
+    free(buf);
+    return 0;
+  }
+
+  // strings in doc point into buf, so it lives as long as doc does
+  doc->input = buf;
+  return 1;
+}
+
 static int read_stdin_line(String_t *line) {
   s_clear(line);
 
@@ -533,42 +2519,59 @@ static int read_stdin_line(String_t *line) {
   return 1;
 }
 
-static int handle_api_response(const char *resp) {
-  // read resp as a null-terminated string slice
-  Str_t resp_as_str = ss_from_cstring(resp);
+// response_stream callback, feeding every chunk of the response to the stream
+// as soon as it arrives
+static int feed_api_response(void *ctx, const char *data, size_t len) {
+  Str_t chunk = {.s = data, .len = len};
+  return json_stream_feed((JsonStream_t *)ctx, chunk);
+}
 
-  TaggedJsonValue_t json;
-  if (!json_parse(resp_as_str, &json)) {
-    fprintf(stderr, "invalid json\n");
+// content is reused for every response. The response is never buffered, only
+// the content is copied out of it
+static int handle_api_response(const char *prompt, const JsonPath_t *path,
+                               String_t *content) {
+  JsonStreamPath_t sp = {.path = path, .result = content};
+  JsonStream_t js;
+  if (!json_stream_init(&js, &json_stream_path_callbacks, &sp))
     return 0;
-  }
 
-  Str_t result;
-  // the result of extract content field is tied to the lifetime of json
-  if (!extract_content_field(&json, &result)) {
-    json_deinit(json);
-    fprintf(stderr, "could not locate target field in json\n");
+  int ok = response_stream(prompt, feed_api_response, &js);
+  json_stream_deinit(&js);
+  if (!ok)
+    return 0;
+
+  // a cut off or invalid response may have had the content in it, but it
+  // can't be trusted
+  if (!sp.done || !sp.found) {
+    fprintf(stderr, "invalid json or could not locate target field in it\n");
     return 0;
   }
 
   // print message
-  ss_print(stdout, result);
+  ss_print(stdout, s_str(content));
   printf("\n");
   fflush(stdout);
 
-  // cleanup json
-  json_deinit(json);
-
   return 1;
 }
 
 static int converse() {
   neurosym_init();
 
+  // can't fail, the path is valid
+  JsonPath_t path;
+  json_path_compile(CONTENT_PATH, &path);
+
   String_t s;
   if (!s_init(&s, 16))
     return 1;
 
+  String_t content;
+  if (!s_init(&content, 256)) {
+    s_deinit(&s);
+    return 1;
+  }
+
   int last_res;
   printf("> What would you like to know? ");
   while ((last_res = read_stdin_line(&s)) == 1) {
@@ -578,41 +2581,42 @@ static int converse() {
       break;
     }
 
-    char *resp = response(s.buf);
-    if (!resp || !handle_api_response(resp)) {
+    if (!handle_api_response(s.buf, &path, &content)) {
       last_res = 0;
       break;
     }
 
-    // response requires we free the buffer
-    free(resp);
     printf("> What would you like to know? ");
   }
 
   printf("Terminating\n");
+  s_deinit(&content);
   s_deinit(&s);
   return last_res != EOF;
 }
 
 static int extract(const char *filename) {
-  TaggedJsonValue_t value;
+  // can't fail, the path is valid
+  JsonPath_t path;
+  json_path_compile(CONTENT_PATH, &path);
 
-  if (!parse_json_file(filename, &value))
+  JsonDocument_t doc;
+  if (!parse_json_file(filename, &path, &doc))
     return 1;
 
-  Str_t content_data;
-  if (!extract_content_field(&value, &content_data)) {
-    json_deinit(value);
+  if (doc.root.type != JSON_STRING) {
+    json_document_deinit(&doc);
     return 1;
   }
 
+  Str_t content_data = doc.root.el.string;
   for (size_t i = 0; i < content_data.len; i++)
     putchar(content_data.s[i]);
 
   printf("\n");
   fflush(stdout);
 
-  json_deinit(value);
+  json_document_deinit(&doc);
   return 0;
 }
 
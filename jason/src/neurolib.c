@@ -129,18 +129,11 @@ int create_socket(const char *hostname, const char *port) {
     return sockfd;
 }
 
-// Function to send a prompt to the API and return the JSON response.
-// It is the caller's responsibility to free the returned string.
+// Function to connect to the API and send it a prompt.
+// Returns the connection the response can be read from, which
+// has to be closed with close_request.
 // If anything goes wrong, return NULL.
-char * response(const char * prompt) {
-    // If library is not initialized, return NULL
-    if (!initialized) {
-        fprintf(stderr, "Not initialized\n");
-        return NULL;
-    }
-    if (api_key == NULL) {
-        return fake_response();
-    }
+static SSL * send_request(const char * prompt, SSL_CTX ** ctx_out, int * sockfd_out) {
     int sockfd = create_socket(api_url, "443");
     if (sockfd < 0) {
         fprintf(stderr, "Failed to create socket\n");
@@ -233,6 +226,36 @@ char * response(const char * prompt) {
         close(sockfd);
         return NULL;
     }
+    *ctx_out = ctx;
+    *sockfd_out = sockfd;
+    return ssl;
+}
+
+// Function to close a connection opened by send_request.
+static void close_request(SSL * ssl, SSL_CTX * ctx, int sockfd) {
+    close(sockfd);
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+}
+
+// Function to send a prompt to the API and return the JSON response.
+// It is the caller's responsibility to free the returned string.
+// If anything goes wrong, return NULL.
+char * response(const char * prompt) {
+    // If library is not initialized, return NULL
+    if (!initialized) {
+        fprintf(stderr, "Not initialized\n");
+        return NULL;
+    }
+    if (api_key == NULL) {
+        return fake_response();
+    }
+    SSL_CTX * ctx;
+    int sockfd;
+    SSL * ssl = send_request(prompt, &ctx, &sockfd);
+    if (ssl == NULL) {
+        return NULL;
+    }
     // Receive the entire response with repeated calls to recv + realloc as needed
     char * buffer = NULL;
     int buffer_size = 0;
@@ -274,8 +297,64 @@ char * response(const char * prompt) {
 
     // Free up all state
     free(buffer);
-    close(sockfd);
-    SSL_free(ssl);
-    SSL_CTX_free(ctx);
+    close_request(ssl, ctx, sockfd);
     return response;
 }
+
+// Function to send a prompt to the API and pass the JSON response
+// to on_data in chunks, as they are received, instead of returning it.
+// on_data returns 0 once it doesn't want any more of the response, because
+// it is done with it or found it broken. Whether it got what it needed is up
+// to on_data to keep track of.
+// If anything goes wrong, or the response ends while on_data still wants
+// more of it, return 0.
+int response_stream(const char * prompt, int (*on_data)(void * data_ctx, const char * data, size_t len), void * data_ctx) {
+    // If library is not initialized, return 0
+    if (!initialized) {
+        fprintf(stderr, "Not initialized\n");
+        return 0;
+    }
+    if (api_key == NULL) {
+        char * fake = fake_response();
+        // the fake response is all there is, so on_data has to be done with it
+        int done = !on_data(data_ctx, fake, strlen(fake));
+        free(fake);
+        return done;
+    }
+    SSL_CTX * ctx;
+    int sockfd;
+    SSL * ssl = send_request(prompt, &ctx, &sockfd);
+    if (ssl == NULL) {
+        return 0;
+    }
+    // Filter out HTTP response headers and pass on only the JSON response
+    // JSON response starts with the first '{' character
+    int in_body = 0;
+    int done = 0;
+    while (1) {
+        char temp[1024];
+        int bytes = SSL_read(ssl, temp, sizeof(temp));
+        if (bytes <= 0) {
+            break;
+        }
+        char * data = temp;
+        if (!in_body) {
+            data = memchr(temp, '{', bytes);
+            if (data == NULL) {
+                continue;
+            }
+            in_body = 1;
+        }
+        if (!on_data(data_ctx, data, temp + bytes - data)) {
+            done = 1;
+            break;
+        }
+    }
+    if (!in_body) {
+        fprintf(stderr, "Failed to parse response\n");
+    }
+
+    // Free up all state
+    close_request(ssl, ctx, sockfd);
+    return in_body && done;
+}
@@ -1,6 +1,8 @@
 #ifndef NEUROLIB_H
 #define NEUROLIB_H
 
+#include <stddef.h>
+
 // Initializes the neurosymbolic library. This function
 // must be called *exactly once* before calling any other
 // function in the library.
@@ -11,4 +13,9 @@ void neurosym_init();
 // If anything goes wrong, returns NULL.
 char * response(const char * prompt);
 
+// Passes the response from the API given a prompt to on_data,
+// in chunks as they are received. Stops reading once on_data
+// returns 0. If anything goes wrong, returns 0.
+int response_stream(const char * prompt, int (*on_data)(void * data_ctx, const char * data, size_t len), void * data_ctx);
+
 #endif
@@ -4,96 +4,918 @@
 #include "../src/jason.c"
 
 void test_number() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data = "-123.22342348E-122";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_NUMBER && "not a number ?!");
+  assert(doc.root.type == JSON_NUMBER && "not a number ?!");
   double expect = -123.22342348E-122;
-  assert(expect == json.el.number && "bad number");
-  json_deinit(json);
+  assert(expect == doc.root.el.number && "bad number");
+  json_document_deinit(&doc);
+}
+
+void test_scalars() {
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  const char *valid[] = {"0", "-0", "10", "-1.5", "2e10", "2E+10", "1.25e-3"};
+  const double expect[] = {0, -0.0, 10, -1.5, 2e10, 2e10, 1.25e-3};
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+    assert(json_parse(ss_from_cstring(valid[i]), &doc) == 1 &&
+           "could not parse number");
+    assert(doc.root.type == JSON_NUMBER && doc.root.el.number == expect[i] &&
+           "bad number");
+  }
+
+  const char *invalid[] = {"+1", ".5",  "1.",   "01",  "0x10", "1e",
+                           "-",  "inf", "nan",  "tru", "nul",  "falsy",
+                           "[truefalse]", "[1true]"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    assert(json_parse(ss_from_cstring(invalid[i]), &doc) == 0 &&
+           "accepted invalid scalar");
+
+  // nothing past the end of the input may be read, even if it would make for
+  // a longer number or a complete literal
+  Str_t number = {.s = "12345", .len = 3};
+  assert(json_parse(number, &doc) == 1 && doc.root.el.number == 123 &&
+         "read past the end of a number");
+  Str_t literal = {.s = "true", .len = 3};
+  assert(json_parse(literal, &doc) == 0 && "read past the end of a literal");
+  Str_t nested = {.s = "[null,false]", .len = 10};
+  assert(json_parse(nested, &doc) == 0 && "read past the end of a literal");
+  json_document_deinit(&doc);
+}
+
+// numbers have to round exactly like strtod does
+void test_number_rounding() {
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  const char *valid[] = {
+      "9007199254740993",
+      "123456789012345678901234567890",
+      "0.1",
+      "1e23",
+      "-2.2250738585072011e-308",
+      "4.9406564584124654e-324",
+      "2.4703282292062328e-324",
+      "1.7976931348623157e308",
+      "0.000000000000000000000000000000000000000001234567890123456789",
+      // exactly halfway between 1 and the next double, and just around it
+      "1.00000000000000011102230246251565404236316680908203125",
+      "1.00000000000000011102230246251565404236316680908203124",
+      "1.00000000000000011102230246251565404236316680908203126",
+      "1e-400",
+      "0e99999999999",
+  };
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+    assert(json_parse(ss_from_cstring(valid[i]), &doc) == 1 &&
+           "could not parse number");
+    double expect = strtod(valid[i], NULL);
+    assert(doc.root.type == JSON_NUMBER &&
+           memcmp(&doc.root.el.number, &expect, sizeof(double)) == 0 &&
+           "bad rounding");
+  }
+
+  // the same, for numbers that aren't copied from a string literal
+  char buf[64];
+  uint64_t bits = 0x123456789ABCDEFULL;
+  for (int i = 0; i < 10000; i++) {
+    bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+    double expect;
+    memcpy(&expect, &bits, sizeof(double));
+    if (isnan(expect) || isinf(expect))
+      continue;
+    int len = snprintf(buf, sizeof(buf), "%.*e", i % 20, expect);
+    expect = strtod(buf, NULL);
+    Str_t number = {.s = buf, .len = (size_t)len};
+    assert(json_parse(number, &doc) == 1 && "could not parse number");
+    assert(memcmp(&doc.root.el.number, &expect, sizeof(double)) == 0 &&
+           "bad rounding");
+  }
+
+  assert(json_parse(ss_from_cstring("1e400"), &doc) == 0 &&
+         "accepted a number too big for a double");
+  assert(json_parse(ss_from_cstring("-1.8e308"), &doc) == 0 &&
+         "accepted a number too big for a double");
+  json_document_deinit(&doc);
+}
+
+void test_exact_integers() {
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  doc.exact_integers = true;
+  const char *valid[] = {"0", "-1", "9007199254740993", "9223372036854775807",
+                         "-9223372036854775808"};
+  const int64_t expect[] = {0, -1, 9007199254740993LL, INT64_MAX, INT64_MIN};
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+    assert(json_parse(ss_from_cstring(valid[i]), &doc) == 1 &&
+           "could not parse integer");
+    assert(doc.root.type == JSON_INTEGER &&
+           doc.root.el.integer == expect[i] && "bad integer");
+  }
+
+  // anything else is still a double
+  const char *doubles[] = {"1.0", "1e2", "9223372036854775808",
+                           "-9223372036854775809"};
+  for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+    assert(json_parse(ss_from_cstring(doubles[i]), &doc) == 1 &&
+           "could not parse number");
+    assert(doc.root.type == JSON_NUMBER &&
+           doc.root.el.number == strtod(doubles[i], NULL) && "bad number");
+  }
+
+  // and without asking for them, integers are doubles too
+  doc.exact_integers = false;
+  assert(json_parse(ss_from_cstring("9007199254740993"), &doc) == 1 &&
+         doc.root.type == JSON_NUMBER &&
+         doc.root.el.number == 9007199254740992.0 && "bad number");
+  json_document_deinit(&doc);
 }
 
 void test_boolean() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data = "false";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_BOOL && "not a bool ?!");
-  assert(!json.el.boolean && "bad boolean");
-  json_deinit(json);
+  assert(doc.root.type == JSON_BOOL && "not a bool ?!");
+  assert(!doc.root.el.boolean && "bad boolean");
+  json_document_deinit(&doc);
 }
 
 void test_string() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data =
       "\"hello good world \\n \\r \\t              \\f\\\" \"";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_STRING && "not a string ?!");
+  assert(doc.root.type == JSON_STRING && "not a string ?!");
   Str_t expect = ss_from_cstring("hello good world \n \r \t              \f\" ");
-  assert(ss_eq(expect, s_str(&json.el.string)) && "bad string");
-  s_deinit(&json.el.string);
-  json_deinit(json);
+  assert(ss_eq(expect, doc.root.el.string) && "bad string");
+  json_document_deinit(&doc);
 }
 
 void test_null() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data = "null";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_NULL && "not a null?!");
-  json_deinit(json);
+  assert(doc.root.type == JSON_NULL && "not a null?!");
+  json_document_deinit(&doc);
 }
 
 void test_array() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data =
       "    [  1, 3 , \"dsfsdfvsdf \\\" \", true, false ,null     ,] \n \n\t ";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_ARRAY && "not a array?!");
-  assert(json.el.array.len == 6 && "bad array length");
-  json_deinit(json);
+  assert(doc.root.type == JSON_ARRAY && "not a array?!");
+  assert(doc.root.el.array.len == 6 && "bad array length");
+  json_document_deinit(&doc);
 }
 
 void test_object() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data = "{ \"1\": 1, \"2\": [1, 2, 3], \"3\": 123.3e-2, "
                           "\"4\": {}, \"5\": true, \"6\": null, }";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
+         "could not parse json string");
+  assert(doc.root.type == JSON_OBJECT && "not a object?!");
+  assert(doc.root.el.object.len == 6 && "bad array length");
+  json_document_deinit(&doc);
+}
+
+// objects are looked up the same way whether they are hashed or not
+void test_small_objects() {
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  String_t data;
+  assert(s_init(&data, 16) && "could not allocate");
+  for (size_t len = 0; len <= 2 * JSON_SMALL_OBJECT; len++) {
+    // every key is there twice, the second one wins
+    s_clear(&data);
+    s_push(&data, '{');
+    for (size_t round = 0; round < 2; round++) {
+      for (size_t i = 0; i < len; i++) {
+        char member[32];
+        snprintf(member, sizeof(member), "\"k%zu\": %zu,", i, round * 100 + i);
+        s_push_cstr(&data, member);
+      }
+    }
+    s_push(&data, '}');
+
+    assert(json_parse(s_str(&data), &doc) == 1 && "could not parse object");
+    JsonObject_t *object = &doc.root.el.object;
+    assert(object->len == len && "bad object length");
+    // duplicates count towards the size until they are merged
+    assert((2 * len <= JSON_SMALL_OBJECT) == json_object_is_small(object) &&
+           "bad object kind");
+    for (size_t i = 0; i < len; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "k%zu", i);
+      TaggedJsonValue_t *v = json_object_get(object, ss_from_cstring(key));
+      assert(v && v->el.number == 100 + i && "bad object value");
+      // small objects keep their keys in order
+      if (json_object_is_small(object))
+        assert(ss_eq(object->buckets[i].k, ss_from_cstring(key)) &&
+               "bad small object order");
+      // hm_get works on both kinds, it's just slower on small ones
+      Str_t k = ss_from_cstring(key);
+      assert(hm_get(Str_t, TaggedJsonValue_t)(object, &k) == v &&
+             "bad hm_get value");
+    }
+    Str_t missing = ss_from_cstring("k");
+    assert(!hm_get(Str_t, TaggedJsonValue_t)(object, &missing) &&
+           "hm_get found missing key");
+    assert(!json_object_get(object, ss_from_cstring("k")) &&
+           "found missing key");
+  }
+
+  s_deinit(&data);
+  json_document_deinit(&doc);
+}
+
+void test_key_interning() {
+  JsonKeys_t keys;
+  assert(json_keys_init(&keys) && "could not allocate keys");
+  JsonDocument_t first, second;
+  assert(json_document_init(&first) && json_document_init(&second) &&
+         "could not allocate document");
+  first.keys = &keys;
+  second.keys = &keys;
+
+  assert(json_parse(ss_from_cstring("{\"a\": 1, \"b\": 2, \"a\": 3}"),
+                    &first) == 1 &&
+         "could not parse object");
+  // escaped keys are interned once they are decoded
+  assert(json_parse(ss_from_cstring("{\"b\": 4, \"c\\/\": 5}"), &second) ==
+             1 &&
+         "could not parse object");
+  Str_t a = json_keys_intern(&keys, ss_from_cstring("a"));
+  Str_t b = json_keys_intern(&keys, ss_from_cstring("b"));
+  Str_t c = json_keys_intern(&keys, ss_from_cstring("c/"));
+  assert(a.s && b.s && c.s && "could not intern key");
+  assert(json_key_id(a) == 1 && json_key_id(b) == 2 && json_key_id(c) == 3 &&
+         "bad key id");
+  assert(keys.ids.len == 3 && "keys interned more than once");
+
+  // both documents share the same copy of b
+  JsonObject_t *object = &first.root.el.object;
+  assert(object->len == 2 && "bad object length");
+  assert(object->buckets[1].k.s == b.s && "key not interned");
+  assert(second.root.el.object.buckets[0].k.s == b.s && "key not interned");
+  assert(second.root.el.object.buckets[1].k.s == c.s && "key not interned");
+
+  assert(json_object_get_interned(object, a)->el.number == 3 &&
+         "bad object value");
+  assert(json_object_get_interned(object, b)->el.number == 2 &&
+         "bad object value");
+  assert(!json_object_get_interned(object, c) && "found missing key");
+  assert(json_object_get_interned(&second.root.el.object, b)->el.number == 4 &&
+         "bad object value");
+  // looking keys up by their bytes still works
+  assert(json_object_get(object, ss_from_cstring("b"))->el.number == 2 &&
+         "bad object value");
+
+  // hashed objects use the hash the key was interned with
+  String_t data;
+  assert(s_init(&data, 16) && "could not allocate");
+  s_push(&data, '{');
+  for (size_t i = 0; i < 2 * JSON_SMALL_OBJECT; i++) {
+    char member[32];
+    snprintf(member, sizeof(member), "\"k%zu\": %zu,", i, i);
+    s_push_cstr(&data, member);
+  }
+  s_push(&data, '}');
+  assert(json_parse(s_str(&data), &first) == 1 && "could not parse object");
+  object = &first.root.el.object;
+  assert(!json_object_is_small(object) && "bad object kind");
+  for (size_t i = 0; i < 2 * JSON_SMALL_OBJECT; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "k%zu", i);
+    Str_t k = json_keys_intern(&keys, ss_from_cstring(key));
+    TaggedJsonValue_t *v = json_object_get_interned(object, k);
+    assert(v && v->el.number == i && "bad object value");
+  }
+  assert(!json_object_get_interned(object, a) && "found missing key");
+
+  s_deinit(&data);
+  json_document_deinit(&second);
+  json_document_deinit(&first);
+  json_keys_deinit(&keys);
+}
+
+void test_borrowed_strings() {
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  const char *json_data = "{\"plain\": \"abc\", \"escaped\": \"a\\nb\"}";
+  assert(json_parse(ss_from_cstring(json_data), &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_OBJECT && "not a object?!");
-  assert(json.el.object.len == 6 && "bad array length");
-  json_deinit(json);
+
+  // strings without escapes point into the input
+  TaggedJsonValue_t *plain =
+      json_object_get(&doc.root.el.object, ss_from_cstring("plain"));
+  assert(plain && ss_eq(plain->el.string, ss_from_cstring("abc")) &&
+         "bad string");
+  assert(plain->el.string.s == json_data + 11 && "plain string was copied");
+
+  // the others are decoded into the document
+  TaggedJsonValue_t *escaped =
+      json_object_get(&doc.root.el.object, ss_from_cstring("escaped"));
+  assert(escaped && ss_eq(escaped->el.string, ss_from_cstring("a\nb")) &&
+         "bad string");
+  assert((escaped->el.string.s < json_data ||
+          escaped->el.string.s >= json_data + strlen(json_data)) &&
+         "escaped string was not decoded");
+
+  // control characters are rejected either way
+  assert(json_parse(ss_from_cstring("\"a\tb\""), &doc) == 0 &&
+         "accepted control character");
+  assert(json_parse(ss_from_cstring("\"\\n\tb\""), &doc) == 0 &&
+         "accepted control character");
+  json_document_deinit(&doc);
 }
 
 void test_unicode() {
-  TaggedJsonValue_t json;
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
   const char *json_data = "\"\\u00a3\"";
   Str_t json_data_slice = ss_from_cstring(json_data);
-  assert(json_parse(json_data_slice, &json) == 1 &&
+  assert(json_parse(json_data_slice, &doc) == 1 &&
          "could not parse json string");
-  assert(json.type == JSON_STRING && "not a string?!");
-  assert(json.el.string.len == 2);
-  assert(json.el.string.buf[0] == 0);
-  assert(json.el.string.buf[1] == (char)0xA3);
-  json_deinit(json);
+  assert(doc.root.type == JSON_STRING && "not a string?!");
+  assert(doc.root.el.string.len == 2);
+  assert(doc.root.el.string.s[0] == 0);
+  assert(doc.root.el.string.s[1] == (char)0xA3);
+  json_document_deinit(&doc);
+}
+
+void test_path_compile() {
+  JsonPath_t path;
+  assert(json_path_compile("choices[0].message.content", &path) == 1 &&
+         "could not compile path");
+  assert(path.len == 4 && "bad path length");
+  assert(ss_eq(path.steps[0].key, ss_from_cstring("choices")) &&
+         !path.steps[0].is_index && "bad key");
+  assert(path.steps[1].is_index && path.steps[1].index == 0 && "bad index");
+  assert(ss_eq(path.steps[3].key, ss_from_cstring("content")) && "bad key");
+
+  assert(json_path_compile("[12][3].a", &path) == 1 && path.len == 3 &&
+         path.steps[0].index == 12 && "could not compile path");
+  assert(json_path_compile("", &path) == 1 && path.len == 0 &&
+         "could not compile empty path");
+
+  const char *invalid[] = {".a", "a.", "a..b", "a[", "a[]", "a[1", "a[x]",
+                           "a.[0]", "[99999999999999999999999]"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    assert(json_path_compile(invalid[i], &path) == 0 &&
+           "compiled invalid path");
+}
+
+// extract path from json_data and check that it is the string expect, or that
+// there is nothing to extract if expect is NULL
+static void check_extract(const char *json_data, const char *path_src,
+                          const char *expect) {
+  JsonPath_t path;
+  assert(json_path_compile(path_src, &path) && "could not compile path");
+
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  int ok = json_extract(ss_from_cstring(json_data), &path, &doc);
+  if (expect)
+    assert(ok && doc.root.type == JSON_STRING &&
+           ss_eq(doc.root.el.string, ss_from_cstring(expect)) &&
+           "bad extracted value");
+  else
+    assert(!ok && "extracted missing value");
+  json_document_deinit(&doc);
+}
+
+void test_extract() {
+  // everything before the value has to be skipped over, strings with
+  // brackets and escaped quotes in them included
+  const char *json_data =
+      "{\"usage\": {\"a\": [1, {\"b\": \"]}\\\\\\\"\"}, [[]], -1.5e3, null]},"
+      " \"choices\": [ {\"x\": \"{[\"}, {\"message\": {\"role\": \"bot\","
+      " \"content\": \"hi \\\"there\\\"\"}},],"
+      " \"k\\/ey\": \"escaped key\", \"dup\": \"first\", \"dup\": \"last\"}";
+  check_extract(json_data, "choices[1].message.content", "hi \"there\"");
+  check_extract(json_data, "choices[0].x", "{[");
+  check_extract(json_data, "usage.a[1].b", "]}\\\"");
+  check_extract(json_data, "k/ey", "escaped key");
+  check_extract(json_data, "dup", "last");
+  check_extract(json_data, "choices[2]", NULL);
+  check_extract(json_data, "usage.b", NULL);
+  check_extract(json_data, "usage[0]", NULL);
+  check_extract(json_data, "choices.message", NULL);
+
+  // only the extracted value is checked completely
+  check_extract("{\"a\": [1 2], \"b\": \"ok\"}", "b", "ok");
+  check_extract("{\"a\": \"ok\", \"b\": [1 2]}", "a", "ok");
+  check_extract("{\"a\": \"ok\\x\"}", "a", NULL);
+  check_extract("{\"a\": [\"ok\"", "a", NULL);
+  check_extract("{\"a\": \"ok", "a", NULL);
+
+  // an empty path is the whole document, which has to be valid
+  check_extract("\"ok\"", "", "ok");
+  check_extract("\"ok\" 1", "", NULL);
+
+  // objects extracted as a whole are the same as if they were parsed
+  JsonPath_t path;
+  JsonDocument_t doc;
+  assert(json_path_compile("choices[1]", &path) && "could not compile path");
+  assert(json_document_init(&doc) && "could not allocate document");
+  assert(json_extract(ss_from_cstring(json_data), &path, &doc) &&
+         doc.root.type == JSON_OBJECT && doc.root.el.object.len == 1 &&
+         "bad extracted object");
+  json_document_deinit(&doc);
+}
+
+// callbacks that write every event they get into a String_t ctx
+static int log_event(void *ctx, const char *event) {
+  return s_push_cstr((String_t *)ctx, event) && s_push((String_t *)ctx, ' ');
+}
+static int log_start_object(void *ctx) { return log_event(ctx, "{"); }
+static int log_end_object(void *ctx) { return log_event(ctx, "}"); }
+static int log_start_array(void *ctx) { return log_event(ctx, "["); }
+static int log_end_array(void *ctx) { return log_event(ctx, "]"); }
+static int log_key(void *ctx, Str_t key) {
+  return s_push_str((String_t *)ctx, key) && log_event(ctx, ":");
+}
+static int log_string(void *ctx, Str_t str) {
+  return s_push((String_t *)ctx, '"') && s_push_str((String_t *)ctx, str) &&
+         log_event(ctx, "\"");
+}
+static int log_number(void *ctx, double n) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%g", n);
+  return log_event(ctx, buf);
+}
+static int log_integer(void *ctx, int64_t n) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "i%lld", (long long)n);
+  return log_event(ctx, buf);
+}
+static int log_boolean(void *ctx, bool b) {
+  return log_event(ctx, b ? "true" : "false");
+}
+static int log_null(void *ctx) { return log_event(ctx, "null"); }
+
+static const JsonStreamCallbacks_t log_callbacks = {
+    .start_object = log_start_object,
+    .end_object = log_end_object,
+    .start_array = log_start_array,
+    .end_array = log_end_array,
+    .key = log_key,
+    .string = log_string,
+    .number = log_number,
+    .boolean = log_boolean,
+    .null = log_null,
+};
+
+// stream s in chunks of chunk_sz bytes, or split once at split if chunk_sz is
+// 0, and log the events into log
+static int stream_chunks(Str_t s, size_t chunk_sz, size_t split,
+                         String_t *log) {
+  JsonStream_t js;
+  assert(json_stream_init(&js, &log_callbacks, log) && "could not allocate");
+  s_clear(log);
+
+  int ok = 1;
+  if (chunk_sz == 0) {
+    Str_t first = {.s = s.s, .len = split};
+    Str_t second = {.s = s.s + split, .len = s.len - split};
+    ok = json_stream_feed(&js, first) && json_stream_feed(&js, second);
+  } else {
+    for (size_t i = 0; ok && i < s.len; i += chunk_sz) {
+      Str_t chunk = {.s = s.s + i,
+                     .len = s.len - i < chunk_sz ? s.len - i : chunk_sz};
+      ok = json_stream_feed(&js, chunk);
+    }
+  }
+
+  ok = ok && json_stream_finish(&js);
+  json_stream_deinit(&js);
+  return ok;
+}
+
+void test_stream() {
+  const char *docs[] = {
+      "{\"a\": [1, -2.5e3, \"x\\\"y\\\\\", true, false, null,], \"b\\n\": {}}",
+      "  [ \"\\u00a3\", [[]], {\"k\": \"v\", }, 0, 123456789 ]  ",
+      "\"just a string\"",
+      "-0.5",
+      "null",
+      "[1,,]",
+      "{\"a\" 1}",
+      "[1 2]",
+      "[truex]",
+      "\"abc",
+      "[1}",
+      "{\"a\": 1]",
+      "1 2",
+      "[\"a\tb\"]",
+      "01",
+      "",
+  };
+
+  String_t expect, got;
+  assert(s_init(&expect, 64) && s_init(&got, 64) && "could not allocate");
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  for (size_t d = 0; d < sizeof(docs) / sizeof(docs[0]); d++) {
+    Str_t s = ss_from_cstring(docs[d]);
+    // the streaming parser accepts exactly what json_parse does
+    int valid = stream_chunks(s, s.len + 1, 0, &expect);
+    assert(valid == json_parse(s, &doc) && "stream disagrees with json_parse");
+
+    // and gives the same events no matter where the chunks are cut
+    for (size_t split = 0; split <= s.len; split++) {
+      assert(stream_chunks(s, 0, split, &got) == valid && "bad split result");
+      assert((!valid || ss_eq(s_str(&expect), s_str(&got))) &&
+             "bad split events");
+    }
+    assert(stream_chunks(s, 1, 0, &got) == valid && "bad byte result");
+    assert((!valid || ss_eq(s_str(&expect), s_str(&got))) &&
+           "bad byte events");
+  }
+
+  stream_chunks(ss_from_cstring(docs[0]), 1, 0, &got);
+  assert(ss_eq(s_str(&got),
+               ss_from_cstring("{ a: [ 1 -2500 \"x\"y\\\" true false null ] "
+                               "b\n: { } } ")) &&
+         "bad events");
+
+  // with an integer callback, integers are reported exactly
+  JsonStreamCallbacks_t exact = log_callbacks;
+  exact.integer = log_integer;
+  JsonStream_t js;
+  assert(json_stream_init(&js, &exact, &got) && "could not allocate");
+  s_clear(&got);
+  assert(json_stream_feed(&js, ss_from_cstring("[9007199254740993, 1.0]")) &&
+         json_stream_finish(&js) && "could not stream integers");
+  assert(ss_eq(s_str(&got), ss_from_cstring("[ i9007199254740993 1 ] ")) &&
+         "bad integer events");
+  json_stream_deinit(&js);
+
+  json_document_deinit(&doc);
+  s_deinit(&expect);
+  s_deinit(&got);
+}
+
+// stream json_data through a JsonStreamPath_t for path, in chunks of chunk_sz
+static void check_stream_path(const char *json_data, const char *path_src,
+                              const char *expect) {
+  JsonPath_t path;
+  assert(json_path_compile(path_src, &path) && "could not compile path");
+
+  String_t result;
+  assert(s_init(&result, 16) && "could not allocate");
+  Str_t s = ss_from_cstring(json_data);
+  for (size_t chunk_sz = 1; chunk_sz <= s.len; chunk_sz++) {
+    JsonStreamPath_t sp = {.path = &path, .result = &result};
+    JsonStream_t js;
+    assert(json_stream_init(&js, &json_stream_path_callbacks, &sp) &&
+           "could not allocate");
+    for (size_t i = 0; i < s.len; i += chunk_sz) {
+      Str_t chunk = {.s = s.s + i,
+                     .len = s.len - i < chunk_sz ? s.len - i : chunk_sz};
+      if (!json_stream_feed(&js, chunk))
+        break;
+    }
+    json_stream_deinit(&js);
+
+    // the string only counts if the document ended
+    if (expect)
+      assert(sp.done && sp.found &&
+             ss_eq(s_str(&result), ss_from_cstring(expect)) &&
+             "bad streamed value");
+    else
+      assert(!(sp.done && sp.found) && "streamed missing value");
+  }
+  s_deinit(&result);
+}
+
+void test_stream_path() {
+  const char *json_data =
+      "{\"usage\": {\"content\": \"no\"}, \"choices\": [{\"message\": "
+      "{\"content\": 1}}, {\"message\": {\"role\": [\"x\"], \"content\": "
+      "\"h\\/i\"}}], \"after\": \"the end\"}";
+  check_stream_path(json_data, "choices[1].message.content", "h/i");
+  check_stream_path(json_data, "after", "the end");
+  check_stream_path(json_data, "choices[0].message.content", NULL);
+  check_stream_path(json_data, "choices[2].message.content", NULL);
+  check_stream_path(json_data, "choices.message", NULL);
+  check_stream_path(json_data, "usage[0]", NULL);
+  check_stream_path(json_data, "usage", NULL);
+  check_stream_path("\"root\"", "", "root");
+
+  // the string is there, but the document is cut off or invalid after it
+  check_stream_path("{\"choices\":[{\"message\":{\"content\":\"hi\"}}",
+                    "choices[0].message.content", NULL);
+  check_stream_path("{\"choices\":[{\"message\":{\"content\":\"hi\", ]]]",
+                    "choices[0].message.content", NULL);
+  check_stream_path(
+      "{\"choices\":[{\"message\":{\"content\":\"hi\"}}], \"x\": tru}",
+      "choices[0].message.content", NULL);
+  check_stream_path("{\"choices\":[{\"message\":{\"content\":\"hi\"}}]}",
+                    "choices[0].message.content", "hi");
+}
+
+// keys that appear more than once are resolved the same way by every API:
+// the last one wins, even if it doesn't have the rest of the path
+void test_duplicate_keys() {
+  const char *cases[][3] = {
+      {"{\"m\": {\"c\": \"a\"}, \"m\": {\"c\": \"b\"}}", "m.c", "b"},
+      {"{\"m\": {\"c\": \"a\"}, \"m\": {\"x\": \"b\"}}", "m.c", NULL},
+      {"{\"m\": {\"c\": \"a\"}, \"m\": 5}", "m.c", NULL},
+      {"{\"m\": [1], \"m\": {\"c\": \"z\", \"c\": \"y\"}}", "m.c", "y"},
+      {"{\"l\": [\"a\", \"b\"], \"l\": [\"c\"]}", "l[0]", "c"},
+      {"{\"l\": [\"a\", \"b\"], \"l\": [\"c\"]}", "l[1]", NULL},
+      {"[{\"c\": {}, \"c\": \"s\"}, 1]", "[0].c", "s"},
+      {"{\"c\": {\"d\": \"s\"}, \"c\": {}}", "c.d", NULL},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    check_extract(cases[i][0], cases[i][1], cases[i][2]);
+    check_stream_path(cases[i][0], cases[i][1], cases[i][2]);
+  }
+
+  // and the same as json_parse
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  assert(json_parse(ss_from_cstring(cases[0][0]), &doc) == 1 &&
+         "could not parse object");
+  TaggedJsonValue_t *m = json_object_get(&doc.root.el.object,
+                                         ss_from_cstring("m"));
+  TaggedJsonValue_t *c = json_object_get(&m->el.object, ss_from_cstring("c"));
+  assert(ss_eq(c->el.string, ss_from_cstring("b")) && "bad parsed value");
+  json_document_deinit(&doc);
+}
+
+// the index stage 1 should produce for s, one byte at a time
+static size_t naive_index(const char *s, size_t len, uint32_t *index,
+                          int *unterminated) {
+  size_t cnt = 0;
+  int in_string = 0, escaped = 0, prev_scalar = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t class = json_char_class[(uint8_t)s[i]];
+    int quote = (class & JSON_CLASS_QUOTE) && !escaped;
+    int scalar = !(class & (JSON_CLASS_OP | JSON_CLASS_WHITESPACE));
+    if (quote) {
+      index[cnt++] = i;
+      in_string = !in_string;
+    } else if (!in_string && ((class & JSON_CLASS_OP) ||
+                              (scalar && !prev_scalar))) {
+      index[cnt++] = i;
+    }
+
+    prev_scalar = scalar && !quote;
+    escaped = (class & JSON_CLASS_BACKSLASH) && !escaped;
+  }
+
+  *unterminated = in_string;
+  return cnt;
+}
+
+static void check_kernel(JsonIndexKernel_t kernel, const char *s, size_t len) {
+  uint32_t *expect = malloc((len + 1) * sizeof(uint32_t));
+  uint32_t *got = malloc((len + 1) * sizeof(uint32_t));
+  assert(expect && got && "could not allocate index");
+
+  int expect_unterminated, got_unterminated;
+  size_t expect_len = naive_index(s, len, expect, &expect_unterminated);
+  size_t got_len = kernel((const uint8_t *)s, len, got, &got_unterminated);
+  assert(expect_len == got_len && "bad index length");
+  assert(expect_unterminated == got_unterminated && "bad string state");
+  assert(memcmp(expect, got, got_len * sizeof(uint32_t)) == 0 && "bad index");
+
+  free(expect);
+  free(got);
+}
+
+void test_structural_index() {
+  JsonIndexKernel_t kernels[3] = {json_index_scalar};
+  size_t kernel_cnt = 1;
+#ifdef JSON_X86
+  if (__builtin_cpu_supports("sse2"))
+    kernels[kernel_cnt++] = json_index_sse2;
+  if (__builtin_cpu_supports("avx2"))
+    kernels[kernel_cnt++] = json_index_avx2;
+#endif
+
+  // runs of backslashes and quotes that cross block boundaries are the
+  // interesting part
+  const char alphabet[] = "\\\\\"\"a 1{}[]:,\n";
+  char buf[512];
+  srand(41);
+  for (int round = 0; round < 2000; round++) {
+    size_t len = rand() % sizeof(buf);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+
+    for (size_t k = 0; k < kernel_cnt; k++)
+      check_kernel(kernels[k], buf, len);
+  }
+}
+
+void test_index_boundaries() {
+  // an escaped quote right at the end of the first block
+  String_t data;
+  assert(s_init(&data, 128) && "could not allocate");
+  s_push(&data, '"');
+  for (int i = 0; i < 61; i++)
+    s_push(&data, 'a');
+  s_push_cstr(&data, "\\\"b\"");
+
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  assert(json_parse(s_str(&data), &doc) == 1 && "could not parse json");
+  assert(doc.root.type == JSON_STRING && doc.root.el.string.len == 63 &&
+         doc.root.el.string.s[61] == '"' && "bad string");
+  s_deinit(&data);
+
+  const char *invalid[] = {"", " ", "truex", "\"abc", "1 2", "[1 2]",
+                           "{\"a\" 1}", "[1,,]", "\"a\"b"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    assert(json_parse(ss_from_cstring(invalid[i]), &doc) == 0 &&
+           "accepted invalid json");
+  json_document_deinit(&doc);
+}
+
+void test_document_reuse() {
+  // big enough to need more than one chunk
+  String_t data;
+  assert(s_init(&data, 16) && "could not allocate");
+  s_push(&data, '[');
+  for (int i = 0; i < 10000; i++)
+    s_push_cstr(&data, "{\"a\": [1, {\"b\": \"c\"}], \"a\": \"d\"},");
+  s_push(&data, ']');
+
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  for (int round = 0; round < 3; round++) {
+    assert(json_parse(s_str(&data), &doc) == 1 && "could not parse json");
+    assert(doc.root.type == JSON_ARRAY && doc.root.el.array.len == 10000 &&
+           "bad array");
+
+    // the last duplicate key wins
+    JsonObject_t *last = &doc.root.el.array.buf[9999].el.object;
+    TaggedJsonValue_t *a = json_object_get(last, ss_from_cstring("a"));
+    assert(last->len == 1 && a && a->type == JSON_STRING &&
+           a->el.string.s[0] == 'd' && "bad object");
+
+    // after the first parse, the arena knows how much memory to keep around
+    if (round > 0)
+      assert(!doc.arena.chunks->next && "document didn't reuse its memory");
+  }
+
+  json_document_deinit(&doc);
+  s_deinit(&data);
+}
+
+// check that the value at c on a tape is the same as value
+static void check_tape_value(JsonCursor_t c, TaggedJsonValue_t *value) {
+  assert(json_cursor_type(c) == value->type && "bad tape type");
+  switch (value->type) {
+  case JSON_STRING:
+    assert(ss_eq(json_cursor_string(c), value->el.string) &&
+           "bad tape string");
+    break;
+  case JSON_NUMBER: {
+    double number = json_cursor_number(c);
+    assert(memcmp(&number, &value->el.number, sizeof(double)) == 0 &&
+           "bad tape number");
+    break;
+  }
+  case JSON_INTEGER:
+    assert(json_cursor_integer(c) == value->el.integer && "bad tape integer");
+    break;
+  case JSON_BOOL:
+    assert(json_cursor_boolean(c) == value->el.boolean && "bad tape boolean");
+    break;
+  case JSON_NULL:
+    break;
+  case JSON_ARRAY: {
+    JsonArray_t *array = &value->el.array;
+    assert(json_cursor_len(c) == array->len && "bad tape array length");
+    JsonCursor_t el;
+    int more = json_cursor_child(c, &el);
+    for (size_t i = 0; i < array->len; i++) {
+      assert(more && "tape array ended early");
+      check_tape_value(el, &array->buf[i]);
+      more = json_cursor_next(&el);
+    }
+    assert(!more && "tape array is too long");
+    break;
+  }
+  case JSON_OBJECT: {
+    JsonObject_t *object = &value->el.object;
+    for (size_t i = 0; i < object->cap; i++) {
+      if (!object->buckets[i].occupied)
+        continue;
+
+      JsonCursor_t v;
+      assert(json_cursor_get(c, object->buckets[i].k, &v) &&
+             "missing tape key");
+      check_tape_value(v, &object->buckets[i].v);
+    }
+    break;
+  }
+  }
+}
+
+void test_tape() {
+  const char *docs[] = {
+      "{\"a\": [1, -2.5e3, \"x\\\"y\\\\\", true, false, null,], \"b\\n\": {}}",
+      "  [ \"\\u00a3\", [[]], {\"k\": \"v\", }, 0, 9007199254740993 ]  ",
+      "{\"dup\": 1, \"dup\": [2], \"e\": \"\", \"o\": {\"p\": {\"q\": [{}]}}}",
+      "\"just a string\"",
+      "-0.5",
+      "null",
+      "[1,,]",
+      "{\"a\" 1}",
+      "[1 2]",
+      "[truex]",
+      "\"abc",
+      "[1}",
+      "{\"a\": 1]",
+      "1 2",
+      "[\"a\tb\"]",
+      "",
+  };
+
+  JsonDocument_t doc;
+  assert(json_document_init(&doc) && "could not allocate document");
+  JsonTape_t tape;
+  assert(json_tape_init(&tape) && "could not allocate tape");
+  for (int exact = 0; exact < 2; exact++) {
+    doc.exact_integers = exact;
+    tape.exact_integers = exact;
+    for (size_t d = 0; d < sizeof(docs) / sizeof(docs[0]); d++) {
+      // the tape can outlive its input
+      size_t len = strlen(docs[d]);
+      char *input = malloc(len + 1);
+      assert(input && "could not allocate");
+      memcpy(input, docs[d], len + 1);
+      int valid = json_tape_parse(ss_from_cstring(input), &tape);
+      free(input);
+
+      assert(valid == json_parse(ss_from_cstring(docs[d]), &doc) &&
+             "tape disagrees with json_parse");
+      if (valid)
+        check_tape_value(json_tape_root(&tape), &doc.root);
+    }
+  }
+
+  // lookups go through the whole path
+  assert(json_tape_parse(ss_from_cstring(docs[2]), &tape) && "bad tape");
+  JsonCursor_t root = json_tape_root(&tape), o, q, el;
+  assert(json_cursor_len(root) == 4 && "bad tape object length");
+  assert(json_cursor_get(root, ss_from_cstring("o"), &o) &&
+         json_cursor_get(o, ss_from_cstring("p"), &q) &&
+         json_cursor_get(q, ss_from_cstring("q"), &q) &&
+         json_cursor_index(q, 0, &el) && json_cursor_type(el) == JSON_OBJECT &&
+         !json_cursor_child(el, &el) && "bad tape lookup");
+  assert(!json_cursor_index(q, 1, &el) && "bad tape index");
+  assert(!json_cursor_get(root, ss_from_cstring("x"), &el) && "bad tape key");
+
+  json_tape_deinit(&tape);
+  json_document_deinit(&doc);
 }
 
 int main(void) {
   test_string();
   test_number();
+  test_scalars();
+  test_number_rounding();
+  test_exact_integers();
   test_boolean();
   test_null();
   test_array();
   test_object();
+  test_small_objects();
+  test_key_interning();
   test_unicode();
+  test_borrowed_strings();
+  test_structural_index();
+  test_index_boundaries();
+  test_document_reuse();
+  test_path_compile();
+  test_extract();
+  test_stream();
+  test_stream_path();
+  test_duplicate_keys();
+  test_tape();
   return 0;
 }
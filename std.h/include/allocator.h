@@ -1,4 +1,5 @@
 #ifndef ALLOCATOR_H
+#include <assert.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -15,19 +16,31 @@ typedef struct {
   const AllocFnTable_t *fns;
 } Mallocator_t;
 
+/* arenas get their memory from the parent in chunks. Allocations follow the
+ * header */
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t sz;
+} ArenaChunk_t;
+
 typedef struct {
   const AllocFnTable_t *fns;
-  uint8_t *buf;
-  size_t sz;
+  /* the chunk allocations are currently made from, followed by all older ones */
+  ArenaChunk_t *chunks;
+  /* the size of new chunks, unless an allocation doesn't fit in one */
+  size_t chunk_sz;
   uint8_t *cursor;
+  uint8_t *end;
   Allocator_t parent;
 } ArenaAllocator_t;
 
 Mallocator_t mallocator_get(void);
 int arena_init(ArenaAllocator_t *arena, size_t sz, Allocator_t parent);
+void arena_reset(ArenaAllocator_t *arena);
 void arena_deinit(ArenaAllocator_t *arena);
 
-#define alloc_get_fns(allocator) ((AllocFnTable_t *)allocator)
+/* every allocator starts with a pointer to its function table */
+#define alloc_get_fns(allocator) (*(const AllocFnTable_t **)(allocator))
 
 #ifdef ALLOC_IMPL
 #include <string.h>
@@ -66,32 +79,72 @@ Mallocator_t mallocator_get(void) {
   };
 }
 
+/* every allocation is preceded by its size and aligned to this */
+#define ARENA_ALIGN 8
+
+static size_t arena_align_up(size_t sz) {
+  return (sz + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static uint8_t *arena_chunk_start(ArenaChunk_t *chunk) {
+  return (uint8_t *)chunk + arena_align_up(sizeof(ArenaChunk_t));
+}
+
+/* get a chunk with room for at least sz bytes from the parent */
+static ArenaChunk_t *arena_chunk_new(ArenaAllocator_t *arena, size_t sz) {
+  size_t total = arena_align_up(sizeof(ArenaChunk_t)) + sz;
+  ArenaChunk_t *chunk = (ArenaChunk_t *)alloc_get_fns(arena->parent)->alloc_fn(
+      arena->parent, total);
+  if (!chunk)
+    return NULL;
+
+  chunk->next = NULL;
+  chunk->sz = sz;
+  return chunk;
+}
+
 void *arena_alloc(Allocator_t alloc, size_t sz) {
   if (sz == 0)
     return NULL;
 
-  sz += 8;
   ArenaAllocator_t *arena = (ArenaAllocator_t *)alloc;
-  /* check if we are within bounds */
-  if (arena->cursor + sz >= arena->buf + arena->sz)
-    return NULL;
+  size_t needed = ARENA_ALIGN + arena_align_up(sz);
+  uint8_t *res;
+  if ((size_t)(arena->end - arena->cursor) >= needed) {
+    res = arena->cursor;
+    arena->cursor += needed;
+  } else if (needed > arena->chunk_sz / 2 && arena->chunks) {
+    /* big allocations get a chunk of their own. It goes behind the current
+     * one, so whatever room is left in that can still be used */
+    ArenaChunk_t *chunk = arena_chunk_new(arena, needed);
+    if (!chunk)
+      return NULL;
 
-  uint8_t *res = arena->cursor;
-  arena->cursor += sz;
+    chunk->next = arena->chunks->next;
+    arena->chunks->next = chunk;
+    res = arena_chunk_start(chunk);
+  } else {
+    /* the current chunk is full, continue in a new one */
+    size_t chunk_sz = needed > arena->chunk_sz ? needed : arena->chunk_sz;
+    ArenaChunk_t *chunk = arena_chunk_new(arena, chunk_sz);
+    if (!chunk)
+      return NULL;
 
-  memset(res, 0, sizeof(size_t));
-  *(size_t *)res = sz;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    res = arena_chunk_start(chunk);
+    arena->cursor = res + needed;
+    arena->end = res + chunk_sz;
+  }
 
-  return res + sizeof(size_t);
+  *(size_t *)res = sz;
+  return res + ARENA_ALIGN;
 }
 
 void *arena_calloc(Allocator_t alloc, size_t item_cnt, size_t item_sz) {
-  /* notice that since this is fixed size, we can't easily reallocate.
-   * Thus instead, we just allocate a new block and return it, after copying the
-   * old data there */
   ArenaAllocator_t *arena = (ArenaAllocator_t *)alloc;
   void *new_block = arena_alloc(arena, item_cnt * item_sz);
-  if (!new_block) /* old block is left untouched anyway */
+  if (!new_block)
     return NULL;
 
   /* zero initialize result */
@@ -101,29 +154,40 @@ void *arena_calloc(Allocator_t alloc, size_t item_cnt, size_t item_sz) {
 void arena_dealloc(Allocator_t alloc, void *buf) {
   (void)alloc;
   (void)buf;
-  /* do nothing */
+  /* do nothing, memory is given back by arena_reset and arena_deinit */
 }
 
 void *arena_realloc(Allocator_t alloc, void *buf, size_t new_sz) {
-  size_t *old_sz = (size_t *)((uint8_t *)buf - sizeof(size_t));
-  if (*old_sz < new_sz) {
-    /* notice that currently the old block is leaked. THIS IS INTENTIONAL */
-    /* reallocation isn't really intended to happen on fixed size allocator */
-    void *res = arena_alloc(alloc, new_sz);
-    if (!res)
-      return NULL;
+  if (!buf)
+    return arena_alloc(alloc, new_sz);
 
-    /* copy old elements into new buffer */
-    return memcpy(res, buf, *old_sz);
-  } else if (*old_sz == new_sz) {
-    /* same buffer does the job */
-    return buf;
-  } else {
+  ArenaAllocator_t *arena = (ArenaAllocator_t *)alloc;
+  size_t *old_sz = (size_t *)((uint8_t *)buf - ARENA_ALIGN);
+  if (*old_sz >= new_sz) {
     /* the new size is smaller than the old one */
     /* we just modify the stored size */
     *old_sz = new_sz;
     return buf;
   }
+
+  /* the last allocation can grow in place if there is room after it */
+  uint8_t *old_end = (uint8_t *)buf + arena_align_up(*old_sz);
+  size_t grow = arena_align_up(new_sz) - arena_align_up(*old_sz);
+  if (old_end == arena->cursor &&
+      (size_t)(arena->end - arena->cursor) >= grow) {
+    arena->cursor += grow;
+    *old_sz = new_sz;
+    return buf;
+  }
+
+  /* notice that currently the old block is leaked. THIS IS INTENTIONAL */
+  /* it is given back along with everything else when the arena is reset */
+  void *res = arena_alloc(alloc, new_sz);
+  if (!res)
+    return NULL;
+
+  /* copy old elements into new buffer */
+  return memcpy(res, buf, *old_sz);
 }
 
 const AllocFnTable_t arena_fns = {
@@ -133,28 +197,75 @@ const AllocFnTable_t arena_fns = {
     .dealloc_fn = arena_dealloc,
 };
 
+/* sz is the size of every chunk the arena gets from parent. The first one is
+ * allocated right away */
 int arena_init(ArenaAllocator_t *arena, size_t sz, Allocator_t parent) {
   memset(arena, 0, sizeof(ArenaAllocator_t));
-  uint8_t *buf = (uint8_t *)alloc_get_fns(parent)->alloc_fn(parent, sz);
-  if (!buf)
-    return 0;
-
-  arena->buf = buf;
-  arena->cursor = buf;
-  arena->sz = sz;
+  arena->chunk_sz = arena_align_up(sz);
   arena->fns = &arena_fns;
   arena->parent = parent;
 
+  ArenaChunk_t *chunk = arena_chunk_new(arena, arena->chunk_sz);
+  if (!chunk) {
+    memset(arena, 0, sizeof(ArenaAllocator_t));
+    return 0;
+  }
+
+  arena->chunks = chunk;
+  arena->cursor = arena_chunk_start(chunk);
+  arena->end = arena->cursor + chunk->sz;
+
   return 1;
 }
 
+static void arena_free_chunks(ArenaAllocator_t *arena) {
+  ArenaChunk_t *chunk = arena->chunks;
+  while (chunk) {
+    ArenaChunk_t *next = chunk->next;
+    alloc_get_fns(arena->parent)->dealloc_fn(arena->parent, chunk);
+    chunk = next;
+  }
+
+  arena->chunks = NULL;
+  arena->cursor = NULL;
+  arena->end = NULL;
+}
+
+/* give back every allocation at once. If the arena had to grow, its chunks are
+ * merged into a single one, so the same amount of memory fits without growing
+ * the next time around */
+void arena_reset(ArenaAllocator_t *arena) {
+  assert(arena->fns && "attempted to reset an uninitialized allocator");
+  if (arena->chunks && !arena->chunks->next) {
+    arena->cursor = arena_chunk_start(arena->chunks);
+    return;
+  }
+
+  size_t total = 0;
+  for (ArenaChunk_t *chunk = arena->chunks; chunk; chunk = chunk->next)
+    total += chunk->sz;
+
+  arena_free_chunks(arena);
+  /* if this fails, the next allocation tries again with a regular chunk */
+  ArenaChunk_t *chunk = arena_chunk_new(arena, total);
+  if (!chunk)
+    return;
+
+  arena->chunks = chunk;
+  arena->cursor = arena_chunk_start(chunk);
+  arena->end = arena->cursor + chunk->sz;
+}
+
 void arena_deinit(ArenaAllocator_t *arena) {
   assert(arena->fns && "attempted to deinitialize an uninitialized allocator");
-  alloc_get_fns(arena->parent)->dealloc_fn(arena->parent, arena->buf);
+  arena_free_chunks(arena);
   memset(arena, 0, sizeof(ArenaAllocator_t));
 }
 #endif // ALLOC_IMPL
 
+/* these shadow the libc functions with the same names. Define
+ * ALLOC_NO_SHORTHANDS when including this next to code that needs those */
+#ifndef ALLOC_NO_SHORTHANDS
 #define alloc(allocator, bytes) ((allocator)->fns->alloc_fn(allocator, bytes))
 
 #define calloc(allocator, type, cnt)                                           \
@@ -164,6 +275,7 @@ void arena_deinit(ArenaAllocator_t *arena) {
   ((allocator)->fns->realloc_fn(allocator, buf, new_sz))
 
 #define dealloc(allocator, buf) ((allocator)->fns->dealloc_fn(allocator, buf))
+#endif // ALLOC_NO_SHORTHANDS
 
 #define ALLOCATOR_H
 #endif // ALLOCATOR_H
@@ -6,6 +6,9 @@
 #include <string.h>
 
 #define FUDGE 2
+/* maximum load factor(as a fraction) before a map is grown on insertion */
+#define HM_MAX_LOAD_NUM 3
+#define HM_MAX_LOAD_DEN 4
 
 #define hm_declare_type(key, value) HashMap_##key##_##value
 #define hm_declare_type_long(key, value) HashMap_##key##_##value##_t
@@ -89,11 +92,6 @@
   }                                                                            \
                                                                                \
   hm_function(int, hm_grow, key, value, struct HashMap(key, value) * hm) {     \
-    KVPair_t(key, value) *new_buckets =                                        \
-        calloc(hm->cap * FUDGE, sizeof(KVPair_t(key, value)));                 \
-    if (!new_buckets)                                                          \
-      return 0;                                                                \
-                                                                               \
     struct HashMap(key, value) new_map;                                        \
     if (!hm_function_call(hm_init, key, value)(&new_map, hm->cap * FUDGE,      \
                                                hm->hash, hm->eq))              \
@@ -121,15 +119,22 @@
   /* TODO: make this return the old value in case of override */               \
   hm_function(int, hm_put, key, value, struct HashMap(key, value) * hm, key k, \
               value v) {                                                       \
+    /* keep probe sequences short by growing before we get too crowded */      \
+    if ((hm->len + 1) * HM_MAX_LOAD_DEN > hm->cap * HM_MAX_LOAD_NUM)           \
+      if (!hm_function_call(hm_grow, key, value)(hm))                          \
+        return 0;                                                              \
+                                                                               \
     uint64_t hash = hm->hash(&k);                                              \
     KVPair_t(key, value) *target_loc =                                         \
         hm_function_call(hm_get_entry_raw, key, value)(hm, &k, hash);          \
     if (target_loc) {                                                          \
+      /* overriding an existing key does not change our length */              \
+      if (!target_loc->occupied)                                               \
+        hm->len++;                                                             \
       target_loc->occupied = 1;                                                \
       target_loc->k = k;                                                       \
       target_loc->v = v;                                                       \
       target_loc->hash = hash;                                                 \
-      hm->len++;                                                               \
       return 1;                                                                \
     }                                                                          \
                                                                                \
@@ -112,7 +112,8 @@ Str_t ss_split_once(Str_t *s, char c) {
       .len = 0,
   };
 
-  while (*s->s != c && s->len > 0) {
+  // check the length first so we never read past the end of the slice
+  while (s->len > 0 && *s->s != c) {
     s->s++;
     s->len--;
     res.len++;
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 #define ALLOC_IMPL
 #include "../include/allocator.h"
 
@@ -38,5 +40,38 @@ int main(void) {
 
   arena_deinit(&arena);
 
+  /* arenas grow past their first chunk */
+  if (!arena_init(&arena, 64, &mallocator)) return 1;
+
+  int *ints[64];
+  for (int i = 0; i < 64; i++) {
+    ints[i] = alloc(&arena, sizeof(int));
+    assert(ints[i] && "could not grow arena");
+    assert((uintptr_t)ints[i] % sizeof(int) == 0 && "misaligned allocation");
+    *ints[i] = i;
+  }
+
+  /* and also take allocations bigger than a chunk */
+  char *big = alloc(&arena, 1000);
+  assert(big && "could not allocate past chunk size");
+  memset(big, 'x', 1000);
+
+  for (int i = 0; i < 64; i++)
+    assert(*ints[i] == i && "arena allocations overlap");
+
+  /* the last allocation grows in place */
+  int *last = alloc(&arena, sizeof(int));
+  assert(realloc(&arena, last, 2 * sizeof(int)) == last &&
+         "last allocation was moved");
+
+  /* after a reset, everything fits into a single chunk */
+  arena_reset(&arena);
+  assert(arena.chunks && !arena.chunks->next && "reset didn't merge chunks");
+  for (int i = 0; i < 64; i++)
+    assert(alloc(&arena, sizeof(int)) && "could not reuse reset arena");
+  assert(!arena.chunks->next && "merged chunk was too small");
+
+  arena_deinit(&arena);
+
   return 0;
 }